@@ -1,7 +1,65 @@
 ﻿#include <iostream>
 #include <vector>
+#include <algorithm>
 #include <ctime>
+#include <chrono>
+#include <deque>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SORTS_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define SORTS_HAS_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(SORTS_HAS_SSE2)
+#define SORTS_PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#elif defined(__GNUC__)
+#define SORTS_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define SORTS_PREFETCH(address) ((void)0)
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SORTS_HAS_POSIX_IO 1
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// io_uring is opt-in: define SORTS_USE_IO_URING to submit file I/O through the kernel ring
+// instead of the pread/pwrite threads. Kernels that refuse the ring still use the threads.
+#if defined(SORTS_USE_IO_URING) && defined(__linux__)
+#define SORTS_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 
 /**
     * @brief SortStrategy template.
@@ -17,34 +75,83 @@ public:
      * @param array The vector to be sorted.
      */
     virtual void sort(std::vector<T>& array) = 0;
+
+    virtual ~SortStrategy() {}
 };
 
-template <typename T>
-class QuickSortStrategy : public SortStrategy<T> {
+template <typename T, typename Compare = std::less<T>>
+class QuickSortStrategy final : public SortStrategy<T> {
 public:
+    /**
+    * @brief Constructs a QuickSortStrategy.
+    * @param compare The ordering to sort by.
+    */
+    explicit QuickSortStrategy(Compare compare = Compare()) : compare(compare) {}
+
     /**
     * @brief Sorts the given vector using the QuickSort algorithm.
+    *
+    * Runs without recursion: after each partition the larger side waits on a fixed-size stack
+    * while the loop continues with the smaller one, so at most log2(n) ranges ever wait. Ranges
+    * of up to 16 elements are finished with insertion sort.
+    *
     * @param array The vector to be sorted.
     */
     void sort(std::vector<T>& array) override {
-        quicksort(array, 0, array.size() - 1);
-    }
+        std::ptrdiff_t pending[2 * 64];
+        int top = 0;
+        std::ptrdiff_t low = 0;
+        std::ptrdiff_t high = static_cast<std::ptrdiff_t>(array.size()) - 1;
 
-private:
-    void quicksort(std::vector<T>& array, int low, int high) {
-        if (low < high) {
-            int pivotIndex = partition(array, low, high);
-            quicksort(array, low, pivotIndex - 1);
-            quicksort(array, pivotIndex + 1, high);
+        while (true) {
+            while (high - low >= smallRange) {
+                std::ptrdiff_t pivotIndex = partition(array, low, high, compare);
+                if (pivotIndex - low < high - pivotIndex) {
+                    pending[top++] = pivotIndex + 1;
+                    pending[top++] = high;
+                    high = pivotIndex - 1;
+                }
+                else {
+                    pending[top++] = low;
+                    pending[top++] = pivotIndex - 1;
+                    low = pivotIndex + 1;
+                }
+            }
+
+            for (std::ptrdiff_t i = low + 1; i <= high; i++) {
+                T key = array[i];
+                std::ptrdiff_t j = i - 1;
+
+                while (j >= low && compare(key, array[j])) {
+                    array[j + 1] = array[j];
+                    j--;
+                }
+
+                array[j + 1] = key;
+            }
+
+            if (top == 0)
+                break;
+
+            high = pending[--top];
+            low = pending[--top];
         }
     }
 
-    int partition(std::vector<T>& array, int low, int high) {
+    /**
+    * @brief Partitions [low, high] around the pivot array[high].
+    * @param array The vector holding the range.
+    * @param low The first index of the range.
+    * @param high The last index of the range, holding the pivot.
+    * @param compare The ordering to partition by.
+    * @return The final index of the pivot; smaller elements are before it, the others after it.
+    */
+    static std::ptrdiff_t partition(std::vector<T>& array, std::ptrdiff_t low, std::ptrdiff_t high, const Compare& compare) {
         T pivot = array[high];
-        int i = low - 1;
+        std::ptrdiff_t i = low - 1;
 
-        for (int j = low; j <= high - 1; j++) {
-            if (array[j] < pivot) {
+        for (std::ptrdiff_t j = low; j <= high - 1; j++) {
+            if (compare(array[j], pivot)) {
                 i++;
                 std::swap(array[i], array[j]);
             }
@@ -53,368 +160,6263 @@ private:
         std::swap(array[i + 1], array[high]);
         return i + 1;
     }
+
+private:
+    static const std::ptrdiff_t smallRange = 16;
+
+    Compare compare;
 };
 
-template <typename T>
-class BubbleSortStrategy : public SortStrategy<T> {
+/**
+    * @brief IncrementalSort template.
+    *
+    * Sorts a vector lazily with incremental quicksort: the next element in order is produced by
+    * partitioning only the part of the vector in front of the last pivot still pending. Reading the
+    * first k elements costs expected O(n + k log k) instead of a full sort. Iterating it is a range
+    * of the elements in order that can be left at any point; an element is consumed once the
+    * iterator moves past it, and the vector is sorted up to the first element not consumed.
+    */
+template <typename T, typename Compare = std::less<T>>
+class IncrementalSort {
 public:
+    class iterator {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        iterator() : owner(nullptr) {}
+        explicit iterator(IncrementalSort* owner) : owner(owner && !owner->done() ? owner : nullptr) {}
+
+        const T& operator*() const { return owner->peek(); }
+        const T* operator->() const { return &owner->peek(); }
+
+        iterator& operator++() {
+            owner->advance();
+            if (owner->done())
+                owner = nullptr;
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const { return owner == other.owner; }
+        bool operator!=(const iterator& other) const { return owner != other.owner; }
+
+    private:
+        IncrementalSort* owner;
+    };
+
     /**
-    * @brief Sorts the given vector using the BubbleSort algorithm.
-    * @param array The vector to be sorted.
+    * @brief Prepares the lazy sort; no element is moved yet.
+    * @param array The vector to be sorted in place. It must outlive this object.
+    * @param compare The ordering to sort by.
     */
-    void sort(std::vector<T>& array) override {
-        int size = array.size();
+    explicit IncrementalSort(std::vector<T>& array, Compare compare = Compare())
+        : array(array), compare(compare), index(0), settled(false) {
+        pivots.reserve(64);
+        pivots.push_back(static_cast<std::ptrdiff_t>(array.size()));
+    }
 
-        for (int i = 0; i < size - 1; i++) {
-            for (int j = 0; j < size - i - 1; j++) {
-                if (array[j] > array[j + 1]) {
-                    std::swap(array[j], array[j + 1]);
-                }
-            }
+    /**
+    * @brief Checks whether every element was produced.
+    */
+    bool done() const { return index == static_cast<std::ptrdiff_t>(array.size()); }
+
+    /**
+    * @brief Returns the number of elements produced so far; they are the sorted prefix of the vector.
+    */
+    std::size_t position() const { return index; }
+
+    /**
+    * @brief Returns the next element in order without consuming it.
+    * @note Must not be called once done() is true.
+    */
+    const T& peek() {
+        settle();
+        return array[index];
+    }
+
+    /**
+    * @brief Returns the next element in order and consumes it.
+    * @note Must not be called once done() is true.
+    */
+    const T& next() {
+        const T& value = peek();
+        advance();
+        return value;
+    }
+
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(); }
+
+private:
+    std::vector<T>& array;
+    Compare compare;
+    std::vector<std::ptrdiff_t> pivots;
+    std::ptrdiff_t index;
+    bool settled;
+
+    void settle() {
+        if (settled)
+            return;
+
+        while (pivots.back() != index) {
+            std::ptrdiff_t high = pivots.back() - 1;
+            std::ptrdiff_t middle = index + (high - index) / 2;
+            if (compare(array[middle], array[index]))
+                std::swap(array[middle], array[index]);
+            if (compare(array[high], array[index]))
+                std::swap(array[high], array[index]);
+            if (compare(array[middle], array[high]))
+                std::swap(array[middle], array[high]);
+
+            pivots.push_back(QuickSortStrategy<T, Compare>::partition(array, index, high, compare));
         }
+        settled = true;
+    }
+
+    void advance() {
+        settle();
+        pivots.pop_back();
+        index++;
+        settled = false;
     }
 };
 
-template <typename T>
-class MergeSortStrategy : public SortStrategy<T> {
+/**
+    * @brief QuickSort3WayStrategy template.
+    *
+    * QuickSort with the Bentley-McIlroy three-way partition: keys equal to the pivot are gathered
+    * in the middle and never looked at again, so inputs with few distinct keys take O(n log k)
+    * time for k distinct keys instead of degrading toward quadratic.
+    */
+template <typename T, typename Compare = std::less<T>>
+class QuickSort3WayStrategy final : public SortStrategy<T> {
 public:
     /**
-    * @brief Sorts the given vector using the MergeSort algorithm.
+    * @brief Constructs a QuickSort3WayStrategy.
+    * @param compare The ordering to sort by.
+    */
+    explicit QuickSort3WayStrategy(Compare compare = Compare()) : compare(compare) {}
+
+    /**
+    * @brief Sorts the given vector using three-way QuickSort.
+    *
+    * Like QuickSortStrategy it keeps the larger side on a fixed-size stack and finishes ranges of
+    * up to 16 elements with insertion sort.
+    *
     * @param array The vector to be sorted.
     */
     void sort(std::vector<T>& array) override {
-        mergesort(array, 0, array.size() - 1);
-    }
+        std::ptrdiff_t pending[2 * 64];
+        int top = 0;
+        std::ptrdiff_t low = 0;
+        std::ptrdiff_t high = static_cast<std::ptrdiff_t>(array.size()) - 1;
 
-private:
-    void mergesort(std::vector<T>& array, int low, int high) {
-        if (low < high) {
-            int middle = low + (high - low) / 2;
-            mergesort(array, low, middle);
-            mergesort(array, middle + 1, high);
-            merge(array, low, middle, high);
-        }
-    }
+        while (true) {
+            while (high - low >= smallRange) {
+                std::ptrdiff_t lessEnd;
+                std::ptrdiff_t greaterBegin;
+                partition(array, low, high, compare, lessEnd, greaterBegin);
 
-    void merge(std::vector<T>& array, int low, int middle, int high) {
-        int leftSize = middle - low + 1;
-        int rightSize = high - middle;
+                if (lessEnd - low < high - greaterBegin) {
+                    pending[top++] = greaterBegin;
+                    pending[top++] = high;
+                    high = lessEnd;
+                }
+                else {
+                    pending[top++] = low;
+                    pending[top++] = lessEnd;
+                    low = greaterBegin;
+                }
+            }
 
-        std::vector<T> leftArray(leftSize);
-        std::vector<T> rightArray(rightSize);
+            for (std::ptrdiff_t i = low + 1; i <= high; i++) {
+                T key = array[i];
+                std::ptrdiff_t j = i - 1;
 
-        for (int i = 0; i < leftSize; i++) {
-            leftArray[i] = array[low + i];
-        }
+                while (j >= low && compare(key, array[j])) {
+                    array[j + 1] = array[j];
+                    j--;
+                }
+
+                array[j + 1] = key;
+            }
+
+            if (top == 0)
+                break;
 
-        for (int j = 0; j < rightSize; j++) {
-            rightArray[j] = array[middle + 1 + j];
+            high = pending[--top];
+            low = pending[--top];
         }
+    }
 
-        int i = 0;
-        int j = 0;
-        int k = low;
+    /**
+    * @brief Partitions [low, high] into keys before, equal to and after a median-of-three pivot.
+    * @param array The vector holding the range; it must hold at least three elements.
+    * @param low The first index of the range.
+    * @param high The last index of the range.
+    * @param compare The ordering to partition by.
+    * @param lessEnd Receives the last index of the keys before the pivot (low - 1 if none).
+    * @param greaterBegin Receives the first index of the keys after the pivot (high + 1 if none).
+    */
+    static void partition(std::vector<T>& array, std::ptrdiff_t low, std::ptrdiff_t high, const Compare& compare,
+        std::ptrdiff_t& lessEnd, std::ptrdiff_t& greaterBegin) {
+        std::ptrdiff_t middle = low + (high - low) / 2;
+        if (compare(array[middle], array[low]))
+            std::swap(array[middle], array[low]);
+        if (compare(array[high], array[low]))
+            std::swap(array[high], array[low]);
+        if (compare(array[high], array[middle]))
+            std::swap(array[high], array[middle]);
+        std::swap(array[low], array[middle]);
 
-        while (i < leftSize && j < rightSize) {
-            if (leftArray[i] <= rightArray[j]) {
-                array[k] = leftArray[i];
-                i++;
+        // Equal keys are parked at both ends while scanning and swapped into the middle afterwards.
+        T pivot = array[low];
+        std::ptrdiff_t i = low;
+        std::ptrdiff_t j = high + 1;
+        std::ptrdiff_t leftEqual = low;
+        std::ptrdiff_t rightEqual = high + 1;
+
+        while (true) {
+            while (compare(array[++i], pivot)) {
+                if (i == high)
+                    break;
             }
-            else {
-                array[k] = rightArray[j];
-                j++;
+            while (compare(pivot, array[--j])) {
+                if (j == low)
+                    break;
             }
-            k++;
-        }
 
-        while (i < leftSize) {
-            array[k] = leftArray[i];
-            i++;
-            k++;
+            if (i == j && !compare(array[i], pivot) && !compare(pivot, array[i]))
+                std::swap(array[++leftEqual], array[i]);
+            if (i >= j)
+                break;
+
+            std::swap(array[i], array[j]);
+            if (!compare(array[i], pivot) && !compare(pivot, array[i]))
+                std::swap(array[++leftEqual], array[i]);
+            if (!compare(array[j], pivot) && !compare(pivot, array[j]))
+                std::swap(array[--rightEqual], array[j]);
         }
 
-        while (j < rightSize) {
-            array[k] = rightArray[j];
-            j++;
-            k++;
+        i = j + 1;
+        for (std::ptrdiff_t k = low; k <= leftEqual; k++) {
+            std::swap(array[k], array[j--]);
+        }
+        for (std::ptrdiff_t k = high; k >= rightEqual; k--) {
+            std::swap(array[k], array[i++]);
         }
+
+        lessEnd = j;
+        greaterBegin = i;
     }
+
+private:
+    static const std::ptrdiff_t smallRange = 16;
+
+    Compare compare;
 };
 
-template <typename T>
-class InsertionSortStrategy : public SortStrategy<T> {
+template <typename T, typename Compare = std::less<T>>
+class BubbleSortStrategy final : public SortStrategy<T> {
 public:
     /**
-    * @brief Sorts the given vector using the InsertionSort algorithm.
+    * @brief Constructs a BubbleSortStrategy.
+    * @param compare The ordering to sort by.
+    */
+    explicit BubbleSortStrategy(Compare compare = Compare()) : compare(compare) {}
+
+    /**
+    * @brief Sorts the given vector using the BubbleSort algorithm.
     * @param array The vector to be sorted.
     */
     void sort(std::vector<T>& array) override {
-        int size = array.size();
+        std::ptrdiff_t size = static_cast<std::ptrdiff_t>(array.size());
 
-        for (int i = 1; i < size; i++) {
-            T key = array[i];
-            int j = i - 1;
-
-            while (j >= 0 && array[j] > key) {
-                array[j + 1] = array[j];
-                j--;
+        for (std::ptrdiff_t i = 0; i < size - 1; i++) {
+            for (std::ptrdiff_t j = 0; j < size - i - 1; j++) {
+                if (compare(array[j + 1], array[j])) {
+                    std::swap(array[j], array[j + 1]);
+                }
             }
-
-            array[j + 1] = key;
         }
     }
+
+private:
+    Compare compare;
 };
 
-template <typename T>
-class HeapSortStrategy : public SortStrategy<T> {
-public:
-    /**
-    * @brief Sorts the given vector using the HeapSort algorithm.
-    * @param array The vector to be sorted.
+/**
+    * @brief SimdMergeTraits template.
+    *
+    * Describes how a type is merged with the vectorized bitonic merge network.
+    * Types without a specialization for the available instruction set keep the scalar merge.
     */
-    void sort(std::vector<T>& array) override {
-        int size = array.size();
+template <typename T>
+struct SimdMergeTraits {
+    static const bool enabled = false;
+};
 
-        for (int i = size / 2 - 1; i >= 0; i--)
-            heapify(array, size, i);
+#if defined(SORTS_HAS_SSE2)
+struct SseLaneShuffles {
+    typedef __m128 Vector;
 
-        for (int i = size - 1; i >= 0; i--) {
+    static Vector reverse(Vector v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)); }
+    static Vector swapHalves(Vector v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)); }
+    static Vector swapPairs(Vector v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)); }
 
-            std::swap(array[0], array[i]);
+    static Vector blendHalves(Vector low, Vector high) {
+        return _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 2, 1, 0));
+    }
 
-            heapify(array, i, 0);
-        }
+    static Vector blendPairs(Vector low, Vector high) {
+        Vector mixed = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+        return _mm_shuffle_ps(mixed, mixed, _MM_SHUFFLE(3, 1, 2, 0));
+    }
+};
+
+struct SseFloatLanes : SseLaneShuffles {
+    static const int width = 4;
+
+    static Vector load(const float* source) { return _mm_loadu_ps(source); }
+    static void store(float* target, Vector v) { _mm_storeu_ps(target, v); }
+    static Vector minOf(Vector a, Vector b) { return _mm_min_ps(a, b); }
+    static Vector maxOf(Vector a, Vector b) { return _mm_max_ps(a, b); }
+};
+
+template <typename U>
+struct SseInt32Lanes : SseLaneShuffles {
+    static const int width = 4;
+
+    static Vector load(const U* source) {
+        return _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source)));
     }
 
+    static void store(U* target, Vector v) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target), _mm_castps_si128(v));
+    }
+
+    static Vector minOf(Vector a, Vector b) { return select(a, b, true); }
+    static Vector maxOf(Vector a, Vector b) { return select(a, b, false); }
+
 private:
-    void heapify(std::vector<T>& array, int size, int rootIndex) {
-        int largest = rootIndex;
-        int left = 2 * rootIndex + 1;
-        int right = 2 * rootIndex + 2;
+    static Vector select(Vector a, Vector b, bool smaller) {
+        __m128i x = _mm_castps_si128(a);
+        __m128i y = _mm_castps_si128(b);
+#if defined(__SSE4_1__)
+        if (std::is_signed<U>::value)
+            return _mm_castsi128_ps(smaller ? _mm_min_epi32(x, y) : _mm_max_epi32(x, y));
+        return _mm_castsi128_ps(smaller ? _mm_min_epu32(x, y) : _mm_max_epu32(x, y));
+#else
+        __m128i bias = _mm_set1_epi32(std::is_signed<U>::value ? 0 : INT32_MIN);
+        __m128i less = _mm_cmplt_epi32(_mm_xor_si128(x, bias), _mm_xor_si128(y, bias));
+        if (!smaller)
+            std::swap(x, y);
+        return _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(less, x), _mm_andnot_si128(less, y)));
+#endif
+    }
+};
 
-        if (left < size && array[left] > array[largest])
-            largest = left;
+template <>
+struct SimdMergeTraits<float> : SseFloatLanes {
+    static const bool enabled = true;
+};
 
-        if (right < size && array[right] > array[largest])
-            largest = right;
+template <>
+struct SimdMergeTraits<std::int32_t> : SseInt32Lanes<std::int32_t> {
+    static const bool enabled = true;
+};
 
-        if (largest != rootIndex) {
-            std::swap(array[rootIndex], array[largest]);
-            heapify(array, size, largest);
-        }
+template <>
+struct SimdMergeTraits<std::uint32_t> : SseInt32Lanes<std::uint32_t> {
+    static const bool enabled = true;
+};
+#endif
+
+#if defined(SORTS_HAS_AVX2)
+struct Avx2LaneShuffles {
+    typedef __m256d Vector;
+
+    static Vector reverse(Vector v) { return _mm256_permute4x64_pd(v, _MM_SHUFFLE(0, 1, 2, 3)); }
+    static Vector swapHalves(Vector v) { return _mm256_permute4x64_pd(v, _MM_SHUFFLE(1, 0, 3, 2)); }
+    static Vector swapPairs(Vector v) { return _mm256_permute_pd(v, 0x5); }
+    static Vector blendHalves(Vector low, Vector high) { return _mm256_blend_pd(low, high, 0xC); }
+    static Vector blendPairs(Vector low, Vector high) { return _mm256_blend_pd(low, high, 0xA); }
+};
+
+struct Avx2DoubleLanes : Avx2LaneShuffles {
+    static const int width = 4;
+
+    static Vector load(const double* source) { return _mm256_loadu_pd(source); }
+    static void store(double* target, Vector v) { _mm256_storeu_pd(target, v); }
+    static Vector minOf(Vector a, Vector b) { return _mm256_min_pd(a, b); }
+    static Vector maxOf(Vector a, Vector b) { return _mm256_max_pd(a, b); }
+};
+
+struct Avx2Int64Lanes : Avx2LaneShuffles {
+    static const int width = 4;
+
+    static Vector load(const std::int64_t* source) {
+        return _mm256_castsi256_pd(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)));
+    }
+
+    static void store(std::int64_t* target, Vector v) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(target), _mm256_castpd_si256(v));
+    }
+
+    static Vector minOf(Vector a, Vector b) {
+        __m256i x = _mm256_castpd_si256(a);
+        __m256i y = _mm256_castpd_si256(b);
+        return _mm256_castsi256_pd(_mm256_blendv_epi8(x, y, _mm256_cmpgt_epi64(x, y)));
+    }
+
+    static Vector maxOf(Vector a, Vector b) {
+        __m256i x = _mm256_castpd_si256(a);
+        __m256i y = _mm256_castpd_si256(b);
+        return _mm256_castsi256_pd(_mm256_blendv_epi8(y, x, _mm256_cmpgt_epi64(x, y)));
     }
 };
 
-template <typename T>
-class MultiThreadMergeSortStrategy : public SortStrategy<T> {
+template <>
+struct SimdMergeTraits<double> : Avx2DoubleLanes {
+    static const bool enabled = true;
+};
+
+template <>
+struct SimdMergeTraits<std::int64_t> : Avx2Int64Lanes {
+    static const bool enabled = true;
+};
+#endif
+
+template <typename Lanes>
+struct BitonicMergeNetwork {
+    typedef typename Lanes::Vector Vector;
+
+    // Takes two ascending registers and leaves the lower half of their union in `low`
+    // and the upper half in `high`, both ascending.
+    static void merge(Vector& low, Vector& high) {
+        Vector reversed = Lanes::reverse(high);
+        Vector smaller = Lanes::minOf(low, reversed);
+        Vector larger = Lanes::maxOf(low, reversed);
+        low = sortBitonic(smaller);
+        high = sortBitonic(larger);
+    }
+
+private:
+    static Vector sortBitonic(Vector v) {
+        Vector partner = Lanes::swapHalves(v);
+        v = Lanes::blendHalves(Lanes::minOf(v, partner), Lanes::maxOf(v, partner));
+        partner = Lanes::swapPairs(v);
+        return Lanes::blendPairs(Lanes::minOf(v, partner), Lanes::maxOf(v, partner));
+    }
+};
+
+template <typename T, typename Compare = std::less<T>>
+class MergeKernel {
 public:
     /**
-     * @brief Sorts the given vector using the Multi-Threaded MergeSort algorithm.
-     * @param array The vector to be sorted.
-     */
-    void sort(std::vector<T>& array) override {
-        multiThreadMergeSort(array, 0, array.size() - 1);
+    * @brief Merges the sorted ranges [low, middle] and [middle + 1, high] of the given vector.
+    * @param array The vector holding both ranges.
+    * @param low The first index of the left range.
+    * @param middle The last index of the left range.
+    * @param high The last index of the right range.
+    * @param scratch Room for high - low + 1 elements that the ranges are copied to first.
+    * @param compare The ordering both ranges are sorted by.
+    */
+    static void merge(std::vector<T>& array, std::ptrdiff_t low, std::ptrdiff_t middle, std::ptrdiff_t high, T* scratch, const Compare& compare = Compare()) {
+        std::ptrdiff_t leftSize = middle - low + 1;
+        std::ptrdiff_t rightSize = high - middle;
+
+        for (std::ptrdiff_t i = 0; i < leftSize + rightSize; i++) {
+            scratch[i] = array[low + i];
+        }
+
+        mergeRuns(scratch, leftSize, scratch + leftSize, rightSize, &array[low], compare);
+    }
+
+    /**
+    * @brief Merges two sorted arrays into the output array.
+    *
+    * 32-bit keys use the SSE bitonic merge network and 64-bit keys the AVX2 one when the
+    * target instruction set provides it. Other trivially copyable types and custom orderings
+    * take a branchless scalar loop and the rest keep the classic branchy one. Ties are taken
+    * from the left array first.
+    *
+    * @param left The first sorted array.
+    * @param leftSize The number of elements in the first array.
+    * @param right The second sorted array.
+    * @param rightSize The number of elements in the second array.
+    * @param out The output array; must not overlap either input.
+    * @param compare The ordering both arrays are sorted by.
+    */
+    static void mergeRuns(const T* left, std::ptrdiff_t leftSize, const T* right, std::ptrdiff_t rightSize, T* out, const Compare& compare = Compare()) {
+        mergeRuns(left, leftSize, right, rightSize, out, compare,
+            std::integral_constant<bool, SimdMergeTraits<T>::enabled && std::is_same<Compare, std::less<T>>::value>());
     }
 
 private:
-    void multiThreadMergeSort(std::vector<T>& array, int low, int high) {
-        if (low < high) {
-            if (high - low < 10000) {
-                mergesort(array, low, high);
-            }
-            else {
-                int middle = low + (high - low) / 2;
+    static void mergeRuns(const T* left, std::ptrdiff_t leftSize, const T* right, std::ptrdiff_t rightSize, T* out, const Compare& compare, std::false_type) {
+        scalarMerge(left, leftSize, right, rightSize, out, compare);
+    }
+
+    static void mergeRuns(const T* left, std::ptrdiff_t leftSize, const T* right, std::ptrdiff_t rightSize, T* out, const Compare& compare, std::true_type) {
+        typedef SimdMergeTraits<T> Lanes;
+        const std::ptrdiff_t width = Lanes::width;
+
+        if (leftSize < width || rightSize < width) {
+            scalarMerge(left, leftSize, right, rightSize, out, compare);
+            return;
+        }
 
-                std::thread leftThread(&MultiThreadMergeSortStrategy<T>::multiThreadMergeSort, this, std::ref(array), low, middle);
-                std::thread rightThread(&MultiThreadMergeSortStrategy<T>::multiThreadMergeSort, this, std::ref(array), middle + 1, high);
+        typename Lanes::Vector low = Lanes::load(left);
+        typename Lanes::Vector high = Lanes::load(right);
+        std::ptrdiff_t i = width;
+        std::ptrdiff_t j = width;
+        std::ptrdiff_t k = 0;
 
-                leftThread.join();
-                rightThread.join();
+        while (true) {
+            BitonicMergeNetwork<Lanes>::merge(low, high);
+            Lanes::store(out + k, low);
+            k += width;
 
-                merge(array, low, middle, high);
+            bool takeLeft = i < leftSize && (j >= rightSize || left[i] <= right[j]);
+            if (takeLeft && leftSize - i >= width) {
+                low = Lanes::load(left + i);
+                i += width;
+            }
+            else if (!takeLeft && j < rightSize && rightSize - j >= width) {
+                low = Lanes::load(right + j);
+                j += width;
+            }
+            else {
+                break;
             }
         }
-    }
 
-    void mergesort(std::vector<T>& array, int low, int high) {
-        if (low < high) {
-            int middle = low + (high - low) / 2;
-            mergesort(array, low, middle);
-            mergesort(array, middle + 1, high);
-            merge(array, low, middle, high);
+        // The carried register still holds the largest elements seen so far and at most one
+        // tail can be longer than a register. Merge the carry with the shorter tail into the
+        // back of the output, then merge that block forward with the longer tail; the forward
+        // merge never writes past the part of the block it has not read yet.
+        T carry[width];
+        Lanes::store(carry, high);
+
+        const T* shortTail = left + i;
+        std::ptrdiff_t shortSize = leftSize - i;
+        const T* longTail = right + j;
+        std::ptrdiff_t longSize = rightSize - j;
+        if (shortSize > longSize) {
+            std::swap(shortTail, longTail);
+            std::swap(shortSize, longSize);
         }
+
+        T* block = out + k + longSize;
+        scalarMerge(carry, width, shortTail, shortSize, block, compare);
+        scalarMerge(longTail, longSize, block, width + shortSize, out + k, compare);
+    }
+
+    static void scalarMerge(const T* left, std::ptrdiff_t leftSize, const T* right, std::ptrdiff_t rightSize, T* out, const Compare& compare) {
+        scalarMerge(left, leftSize, right, rightSize, out, compare, std::is_trivially_copyable<T>());
     }
 
-    void merge(std::vector<T>& array, int low, int middle, int high) {
-        int leftSize = middle - low + 1;
-        int rightSize = high - middle;
+    // Cheap-to-copy elements: pick the winning side with a data dependency instead of a
+    // branch, so random keys do not pay for a mispredict on every output element.
+    static void scalarMerge(const T* left, std::ptrdiff_t leftSize, const T* right, std::ptrdiff_t rightSize, T* out, const Compare& compare, std::true_type) {
+        const T* leftEnd = left + leftSize;
+        const T* rightEnd = right + rightSize;
 
-        std::vector<T> leftArray(leftSize);
-        std::vector<T> rightArray(rightSize);
+        while (left != leftEnd && right != rightEnd) {
+            bool takeLeft = !compare(*right, *left);
+            const T* winner = takeLeft ? left : right;
+            *out++ = *winner;
+            left += takeLeft;
+            right += !takeLeft;
+        }
 
-        for (int i = 0; i < leftSize; i++) {
-            leftArray[i] = array[low + i];
+        while (left != leftEnd) {
+            *out++ = *left++;
         }
 
-        for (int j = 0; j < rightSize; j++) {
-            rightArray[j] = array[middle + 1 + j];
+        while (right != rightEnd) {
+            *out++ = *right++;
         }
+    }
 
-        int i = 0;
-        int j = 0;
-        int k = low;
+    static void scalarMerge(const T* left, std::ptrdiff_t leftSize, const T* right, std::ptrdiff_t rightSize, T* out, const Compare& compare, std::false_type) {
+        std::ptrdiff_t i = 0;
+        std::ptrdiff_t j = 0;
+        std::ptrdiff_t k = 0;
 
         while (i < leftSize && j < rightSize) {
-            if (leftArray[i] <= rightArray[j]) {
-                array[k] = leftArray[i];
+            if (!compare(right[j], left[i])) {
+                out[k] = left[i];
                 i++;
             }
             else {
-                array[k] = rightArray[j];
+                out[k] = right[j];
                 j++;
             }
             k++;
         }
 
         while (i < leftSize) {
-            array[k] = leftArray[i];
+            out[k] = left[i];
             i++;
             k++;
         }
 
         while (j < rightSize) {
-            array[k] = rightArray[j];
+            out[k] = right[j];
             j++;
             k++;
         }
     }
 };
 
-template <typename T>
-class SortStrategyFactory {
+template <typename T, typename Compare = std::less<T>>
+class MergeSortStrategy final : public SortStrategy<T> {
 public:
     /**
-    * @brief Creates a specific sorting strategy based on the provided algorithm.
-    * @param algorithm The algorithm name.
-    * @return A pointer to the created SortStrategy object, or nullptr if the algorithm is not supported.
+    * @brief Constructs a MergeSortStrategy.
+    * @param compare The ordering to sort by.
     */
-    static SortStrategy<T>* createSortStrategy(const std::string& algorithm) {
-        if (algorithm == "quicksort") {
-            return new QuickSortStrategy<T>();
-        }
-        else if (algorithm == "mergesort") {
-            return new MergeSortStrategy<T>();
-        }
-        else if (algorithm == "bubblesort") {
-            return new BubbleSortStrategy<T>();
-        }
-        else if (algorithm == "insertionsort") {
-            return new InsertionSortStrategy<T>();
-        }
-        else if (algorithm == "multithreadmergesort") {
-            return new MultiThreadMergeSortStrategy<T>();
-        }
-        else if (algorithm == "heapsort") {
-            return new HeapSortStrategy<T>();
-        }
+    explicit MergeSortStrategy(Compare compare = Compare()) : compare(compare) {}
 
-        else {
-            std::cout << "Invalid sorting algorithm." << std::endl;
+    /**
+    * @brief Sorts the given vector using the MergeSort algorithm.
+    * @param array The vector to be sorted.
+    */
+    void sort(std::vector<T>& array) override {
+        if (buffer.size() < array.size()) {
+            buffer.resize(array.size());
         }
 
-        return nullptr;
+        sortRange(array, 0, static_cast<std::ptrdiff_t>(array.size()), buffer.data(), compare);
+    }
+
+    /**
+    * @brief Stably sorts [first, last) of the given vector with a bottom-up merge sort.
+    *
+    * Runs of 16 elements are insertion sorted first and then merged in rounds of doubling width,
+    * without recursion.
+    *
+    * @param array The vector holding the range.
+    * @param first The first index of the range.
+    * @param last The index one past the range.
+    * @param scratch Room for last - first elements.
+    * @param compare The ordering to sort by.
+    */
+    static void sortRange(std::vector<T>& array, std::ptrdiff_t first, std::ptrdiff_t last, T* scratch, const Compare& compare) {
+        const std::ptrdiff_t runLength = 16;
+
+        for (std::ptrdiff_t low = first; low < last; low += runLength) {
+            std::ptrdiff_t high = std::min(low + runLength, last);
+            for (std::ptrdiff_t i = low + 1; i < high; i++) {
+                T key = array[i];
+                std::ptrdiff_t j = i - 1;
+
+                while (j >= low && compare(key, array[j])) {
+                    array[j + 1] = array[j];
+                    j--;
+                }
+
+                array[j + 1] = key;
+            }
+        }
+
+        for (std::ptrdiff_t width = runLength; width < last - first; width *= 2) {
+            for (std::ptrdiff_t low = first; low + width < last; low += 2 * width) {
+                std::ptrdiff_t high = std::min(low + 2 * width, last) - 1;
+                MergeKernel<T, Compare>::merge(array, low, low + width - 1, high, scratch + (low - first), compare);
+            }
+        }
     }
-};
 
-template <typename T>
-class SortingTimerDecorator : public SortStrategy<T> {
 private:
-    SortStrategy<T>* strategy;
+    Compare compare;
+    std::vector<T> buffer;
+};
 
+template <typename T, typename Compare = std::less<T>>
+class InsertionSortStrategy final : public SortStrategy<T> {
 public:
     /**
-    * @brief Constructs a SortingTimerDecorator object.
-    * @param strategy The underlying sorting strategy to be decorated.
+    * @brief Constructs a InsertionSortStrategy.
+    * @param compare The ordering to sort by.
     */
-    SortingTimerDecorator(SortStrategy<T>* strategy) : strategy(strategy) {}
+    explicit InsertionSortStrategy(Compare compare = Compare()) : compare(compare) {}
 
     /**
-    * @brief Sorts the given vector using the decorated strategy and measures the sorting time.
+    * @brief Sorts the given vector using the InsertionSort algorithm.
     * @param array The vector to be sorted.
     */
     void sort(std::vector<T>& array) override {
-        clock_t startTime = clock();
-        strategy->sort(array);
-        clock_t endTime = clock();
+        std::ptrdiff_t size = static_cast<std::ptrdiff_t>(array.size());
 
-        double timeTaken = double(endTime - startTime) / CLOCKS_PER_SEC;
-        std::cout << "Sorting time: " << timeTaken << " seconds" << std::endl;
+        for (std::ptrdiff_t i = 1; i < size; i++) {
+            T key = array[i];
+            std::ptrdiff_t j = i - 1;
+
+            while (j >= 0 && compare(key, array[j])) {
+                array[j + 1] = array[j];
+                j--;
+            }
+
+            array[j + 1] = key;
+        }
     }
+
+private:
+    Compare compare;
 };
 
-template <typename T>
-class SortingFacade {
+template <typename T, typename Compare = std::less<T>>
+class HeapSortStrategy final : public SortStrategy<T> {
+public:
+    /**
+    * @brief Constructs a HeapSortStrategy.
+    * @param compare The ordering to sort by.
+    */
+    explicit HeapSortStrategy(Compare compare = Compare()) : compare(compare) {}
+
+    /**
+    * @brief Sorts the given vector using the HeapSort algorithm.
+    * @param array The vector to be sorted.
+    */
+    void sort(std::vector<T>& array) override {
+        std::ptrdiff_t size = static_cast<std::ptrdiff_t>(array.size());
+
+        for (std::ptrdiff_t i = size / 2 - 1; i >= 0; i--)
+            heapify(array, size, i);
+
+        for (std::ptrdiff_t i = size - 1; i >= 0; i--) {
+
+            std::swap(array[0], array[i]);
+
+            heapify(array, i, 0);
+        }
+    }
+
 private:
-    static SortingFacade<T>* instance;
-    SortStrategy<T>* sortStrategy;
-    SortingTimerDecorator<T>* timerDecorator;
+    Compare compare;
+
+    void heapify(std::vector<T>& array, std::ptrdiff_t size, std::ptrdiff_t rootIndex) {
+        std::ptrdiff_t largest = rootIndex;
+        std::ptrdiff_t left = 2 * rootIndex + 1;
+        std::ptrdiff_t right = 2 * rootIndex + 2;
+
+        if (left < size && compare(array[largest], array[left]))
+            largest = left;
+
+        if (right < size && compare(array[largest], array[right]))
+            largest = right;
+
+        if (largest != rootIndex) {
+            std::swap(array[rootIndex], array[largest]);
+            heapify(array, size, largest);
+        }
+    }
+};
 
-    SortingFacade() : sortStrategy(nullptr), timerDecorator(nullptr) {}
+struct NoHeapTracking {
+    template <typename T>
+    void operator()(const T&, std::size_t) const {}
+};
 
+template <typename T, int Arity, typename Compare = std::less<T>, typename Tracker = NoHeapTracking>
+class DaryHeapOps {
 public:
+    static const std::size_t cacheLineSize = 64;
+
     /**
-    * @brief Returns the singleton instance of SortingFacade.
-    * @return The singleton instance.
+    * @brief Resizes the storage and returns a heap base whose sibling groups start on cache line boundaries.
+    *
+    * The root is placed Arity - 1 slots past an aligned address, so the children of every
+    * node begin on an Arity-element boundary. Types whose size does not divide a cache line
+    * fall back to the unaligned start of the storage.
+    *
+    * @param storage The vector that owns the heap slots.
+    * @param size The number of heap elements needed.
+    * @return A pointer to the heap root inside the storage.
     */
-    static SortingFacade<T>* getInstance() {
-        if (instance == nullptr) {
-            instance = new SortingFacade<T>();
+    static T* alignedHeap(std::vector<T>& storage, std::size_t size) {
+        const std::size_t slack = Arity + cacheLineSize / sizeof(T);
+        if (storage.size() < size + slack) {
+            storage.resize(size + slack);
         }
-        return instance;
+
+        std::size_t offset = alignedRootOffset(storage.data());
+        return storage.data() + (offset ? offset : Arity - 1);
     }
 
     /**
-    * @brief Destructor. Cleans up allocated memory.
+    * @brief Returns the index past base at which a heap root makes sibling groups start on cache line boundaries.
+    * @param base The first slot available to the heap.
+    * @return The root index, at most Arity - 1 + cacheLineSize / sizeof(T), or 0 for types whose
+    * size does not divide a cache line.
     */
-    ~SortingFacade() {
-        delete sortStrategy;
-        delete timerDecorator;
+    static std::size_t alignedRootOffset(const T* base) {
+        if (cacheLineSize % sizeof(T) != 0)
+            return 0;
+
+        std::size_t misalignment = reinterpret_cast<std::uintptr_t>(base) % cacheLineSize;
+        if (misalignment % sizeof(T) != 0)
+            return 0;
+
+        return ((cacheLineSize - misalignment) % cacheLineSize) / sizeof(T) + (Arity - 1);
     }
 
     /**
-    * @brief Sets the sorting strategy based on the provided algorithm name.
-    * @param algorithm The algorithm name.
+    * @brief Moves a heap into fresh aligned storage with room for more elements.
+    * @param storage The vector that owns the heap slots; replaced by the larger one.
+    * @param offset The index of the heap root inside the storage.
+    * @param size The number of heap elements to keep.
+    * @param capacity The number of heap elements the new storage must hold.
+    * @return The index of the heap root inside the new storage.
     */
-    void setSortStrategy(const std::string& algorithm) {
-        if (sortStrategy) {
-            delete sortStrategy;
+    static std::size_t reallocate(std::vector<T>& storage, std::size_t offset, std::size_t size, std::size_t capacity) {
+        std::vector<T> larger;
+        T* heap = alignedHeap(larger, capacity);
+        std::move(storage.data() + offset, storage.data() + offset + size, heap);
+        storage.swap(larger);
+        return heap - storage.data();
+    }
+
+    /**
+    * @brief Rearranges the elements into a heap bottom-up in linear time.
+    * @param heap The heap root.
+    * @param size The number of elements.
+    * @param compare The ordering; the root ends up as the element no other element precedes.
+    * @param tracker Told about every slot an element is written to.
+    */
+    static void makeHeap(T* heap, std::size_t size, Compare& compare, Tracker tracker = Tracker()) {
+        std::size_t firstLeaf = size < 2 ? size : (size - 2) / Arity + 1;
+
+        for (std::size_t i = firstLeaf; i-- > 0;) {
+            T value = std::move(heap[i]);
+            siftHole(heap, size, i, value, compare, tracker);
         }
 
-        sortStrategy = SortStrategyFactory<T>::createSortStrategy(algorithm);
+        // Leaves that no sift touched still have to be reported once.
+        for (std::size_t i = firstLeaf; i < size; i++) {
+            tracker(heap[i], i);
+        }
     }
+
     /**
-    * @brief Sorts the given vector using the currently set sorting strategy.
-    * @param array The vector to be sorted.
-    * @note If no sorting strategy is set, an error message will be displayed.
+    * @brief Fills the hole at the given index with the value using Floyd's bottom-up sift-down.
+    *
+    * The hole is first walked down to a leaf along the larger children, which needs one
+    * comparison per child and none against the value, and the value is then sifted back up.
+    *
+    * @param heap The heap root.
+    * @param size The number of elements.
+    * @param hole The index of the slot to fill.
+    * @param value The value to place.
+    * @param compare The ordering.
+    * @param tracker Told about every slot an element is written to.
+    * @return The index where the value was placed.
     */
-    void sort(std::vector<T>& array) {
-        if (!sortStrategy) {
-            std::cout << "Need to set Sorting Strategy." << std::endl;
+    static std::size_t siftHole(T* heap, std::size_t size, std::size_t hole, T& value, Compare& compare,
+        Tracker tracker = Tracker()) {
+        const std::size_t start = hole;
+
+        while (true) {
+            std::size_t first = Arity * hole + 1;
+            if (first >= size)
+                break;
+
+            prefetchGrandchildren(heap, Arity * first + 1, size);
+
+            std::size_t last = std::min(first + Arity, size);
+            std::size_t best = first;
+            for (std::size_t child = first + 1; child < last; child++) {
+                best = compare(heap[best], heap[child]) ? child : best;
+            }
+
+            heap[hole] = std::move(heap[best]);
+            tracker(heap[hole], hole);
+            hole = best;
+        }
+
+        return siftUp(heap, hole, start, value, compare, tracker);
+    }
+
+    /**
+    * @brief Moves the value from the hole towards the root until its parent does not precede it.
+    * @param heap The heap root.
+    * @param hole The index of the slot to fill.
+    * @param top The index the value must not rise above.
+    * @param value The value to place.
+    * @param compare The ordering.
+    * @param tracker Told about every slot an element is written to.
+    * @return The index where the value was placed.
+    */
+    static std::size_t siftUp(T* heap, std::size_t hole, std::size_t top, T& value, Compare& compare,
+        Tracker tracker = Tracker()) {
+        while (hole > top) {
+            std::size_t parent = (hole - 1) / Arity;
+            if (!compare(heap[parent], value))
+                break;
+
+            heap[hole] = std::move(heap[parent]);
+            tracker(heap[hole], hole);
+            hole = parent;
+        }
+
+        heap[hole] = std::move(value);
+        tracker(heap[hole], hole);
+        return hole;
+    }
+
+private:
+    static void prefetchGrandchildren(const T* heap, std::size_t first, std::size_t size) {
+        if (first >= size)
+            return;
+
+        const char* begin = reinterpret_cast<const char*>(heap + first);
+        for (std::size_t offset = 0; offset < Arity * Arity * sizeof(T); offset += cacheLineSize) {
+            SORTS_PREFETCH(begin + offset);
+        }
+    }
+};
+
+template <typename T, int Arity = 4, typename Compare = std::less<T>>
+class DaryHeap {
+public:
+    /**
+    * @brief Constructs an empty heap.
+    * @param compare The ordering; top() is the element no other element precedes, as in std::priority_queue.
+    */
+    explicit DaryHeap(const Compare& compare = Compare()) : compare(compare), offset(0), capacity(0), count(0) {}
+
+    /**
+    * @brief Replaces the contents with the given values and heapifies them in linear time.
+    * @param first The beginning of the values.
+    * @param last The end of the values.
+    */
+    template <typename InputIterator>
+    void assign(InputIterator first, InputIterator last) {
+        clear();
+        for (; first != last; ++first) {
+            if (count == capacity)
+                grow();
+
+            heap()[count] = *first;
+            count++;
+        }
+
+        Heap::makeHeap(heap(), count, compare);
+    }
+
+    /**
+    * @brief Adds a value to the heap.
+    * @param value The value to add.
+    */
+    void push(const T& value) {
+        if (count == capacity)
+            grow();
+
+        T copy = value;
+        Heap::siftUp(heap(), count, 0, copy, compare);
+        count++;
+    }
+
+    /**
+    * @brief Removes the top value.
+    * @note The heap must not be empty.
+    */
+    void pop() {
+        count--;
+        if (count == 0)
+            return;
+
+        T last = std::move(heap()[count]);
+        Heap::siftHole(heap(), count, 0, last, compare);
+    }
+
+    /**
+    * @brief Returns the top value.
+    * @note The heap must not be empty.
+    */
+    const T& top() const { return heap()[0]; }
+
+    /**
+    * @brief Checks whether the heap holds no values.
+    */
+    bool empty() const { return count == 0; }
+
+    /**
+    * @brief Returns the number of queued values.
+    */
+    std::size_t size() const { return count; }
+
+    /**
+    * @brief Removes all values.
+    */
+    void clear() { count = 0; }
+
+private:
+    typedef DaryHeapOps<T, Arity, Compare> Heap;
+
+    Compare compare;
+    std::vector<T> storage;
+    std::size_t offset;
+    std::size_t capacity;
+    std::size_t count;
+
+    T* heap() { return storage.data() + offset; }
+    const T* heap() const { return storage.data() + offset; }
+
+    void grow() {
+        capacity = capacity < 16 ? 16 : capacity * 2;
+        offset = Heap::reallocate(storage, offset, count, capacity);
+    }
+};
+
+template <typename T, int Arity = 4, typename Compare = std::less<T>>
+class AddressableDaryHeap {
+public:
+    typedef std::size_t Handle;
+
+    /**
+    * @brief Constructs an empty heap.
+    * @param compare The ordering; top() is the element no other element precedes, as in std::priority_queue.
+    */
+    explicit AddressableDaryHeap(const Compare& compare = Compare()) : compare(compare), offset(0), capacity(0), count(0) {}
+
+    /**
+    * @brief Replaces the contents with the given values and heapifies them in linear time.
+    * @param first The beginning of the values.
+    * @param last The end of the values.
+    */
+    template <typename InputIterator>
+    void assign(InputIterator first, InputIterator last) {
+        clear();
+        for (; first != last; ++first) {
+            if (count == capacity)
+                grow();
+
+            heap()[count] = Entry(*first, allocateHandle());
+            count++;
+        }
+
+        EntryCompare entryCompare(compare);
+        Heap::makeHeap(heap(), count, entryCompare, tracker());
+    }
+
+    /**
+    * @brief Adds a value to the heap.
+    * @param value The value to add.
+    * @return A handle that identifies the value until it is popped.
+    */
+    Handle push(const T& value) {
+        if (count == capacity)
+            grow();
+
+        Handle handle = allocateHandle();
+        Entry entry(value, handle);
+        EntryCompare entryCompare(compare);
+        Heap::siftUp(heap(), count, 0, entry, entryCompare, tracker());
+        count++;
+        return handle;
+    }
+
+    /**
+    * @brief Removes the top value.
+    * @note The heap must not be empty.
+    */
+    void pop() {
+        releaseHandle(heap()[0].handle);
+        count--;
+        if (count == 0)
             return;
+
+        Entry last = std::move(heap()[count]);
+        EntryCompare entryCompare(compare);
+        Heap::siftHole(heap(), count, 0, last, entryCompare, tracker());
+    }
+
+    /**
+    * @brief Replaces the value behind a handle and restores the heap order (decrease-key / increase-key).
+    * @param handle A handle returned by push() or assign() whose value is still queued.
+    * @param value The new value.
+    */
+    void updateKey(Handle handle, const T& value) {
+        std::size_t index = positions[handle];
+        Entry entry(value, handle);
+        EntryCompare entryCompare(compare);
+
+        if (compare(heap()[index].value, value))
+            Heap::siftUp(heap(), index, 0, entry, entryCompare, tracker());
+        else
+            Heap::siftHole(heap(), count, index, entry, entryCompare, tracker());
+    }
+
+    /**
+    * @brief Returns the top value.
+    * @note The heap must not be empty.
+    */
+    const T& top() const { return heap()[0].value; }
+
+    /**
+    * @brief Returns the handle of the top value.
+    * @note The heap must not be empty.
+    */
+    Handle topHandle() const { return heap()[0].handle; }
+
+    /**
+    * @brief Returns the value currently stored behind a handle.
+    * @param handle A handle whose value is still queued.
+    */
+    const T& value(Handle handle) const { return heap()[positions[handle]].value; }
+
+    /**
+    * @brief Checks whether the heap holds no values.
+    */
+    bool empty() const { return count == 0; }
+
+    /**
+    * @brief Returns the number of queued values.
+    */
+    std::size_t size() const { return count; }
+
+    /**
+    * @brief Removes all values and invalidates every handle.
+    */
+    void clear() {
+        count = 0;
+        positions.clear();
+        freeHandles.clear();
+    }
+
+private:
+    struct Entry {
+        T value;
+        Handle handle;
+
+        Entry() : value(), handle(0) {}
+        Entry(const T& value, Handle handle) : value(value), handle(handle) {}
+    };
+
+    struct EntryCompare {
+        Compare& compare;
+
+        explicit EntryCompare(Compare& compare) : compare(compare) {}
+        bool operator()(const Entry& a, const Entry& b) { return compare(a.value, b.value); }
+    };
+
+    struct PositionTracker {
+        std::size_t* positions;
+
+        void operator()(const Entry& entry, std::size_t index) const { positions[entry.handle] = index; }
+    };
+
+    typedef DaryHeapOps<Entry, Arity, EntryCompare, PositionTracker> Heap;
+
+    Compare compare;
+    std::vector<Entry> storage;
+    std::size_t offset;
+    std::size_t capacity;
+    std::size_t count;
+    std::vector<std::size_t> positions;
+    std::vector<Handle> freeHandles;
+
+    Entry* heap() { return storage.data() + offset; }
+    const Entry* heap() const { return storage.data() + offset; }
+
+    PositionTracker tracker() {
+        PositionTracker result = { positions.data() };
+        return result;
+    }
+
+    Handle allocateHandle() {
+        if (!freeHandles.empty()) {
+            Handle handle = freeHandles.back();
+            freeHandles.pop_back();
+            return handle;
         }
 
-        if (timerDecorator) {
-            delete timerDecorator;
+        positions.push_back(0);
+        return positions.size() - 1;
+    }
+
+    void releaseHandle(Handle handle) {
+        freeHandles.push_back(handle);
+    }
+
+    void grow() {
+        capacity = capacity < 16 ? 16 : capacity * 2;
+        offset = Heap::reallocate(storage, offset, count, capacity);
+    }
+};
+
+template <typename T, typename Compare = std::less<T>>
+class FastHeapSortStrategy final : public SortStrategy<T> {
+public:
+    /**
+    * @brief Constructs a FastHeapSortStrategy.
+    * @param compare The ordering to sort by.
+    */
+    explicit FastHeapSortStrategy(Compare compare = Compare()) : compare(compare) {}
+
+    /**
+    * @brief Sorts the given vector using a cache-aligned 4-ary HeapSort with bottom-up sift-down.
+    *
+    * The heap lives in the vector itself, rooted a few slots in so that sibling groups start on
+    * cache line boundaries. The slots before the root receive the smallest elements, which are
+    * selected and sorted first. No memory is allocated.
+    *
+    * @param array The vector to be sorted.
+    */
+    void sort(std::vector<T>& array) override {
+        std::size_t size = array.size();
+        if (size < 2)
+            return;
+
+        std::size_t offset = Heap::alignedRootOffset(array.data());
+        if (offset >= size) {
+            offset = 0;
+        }
+        if (offset > 0) {
+            std::nth_element(array.begin(), array.begin() + offset, array.end(), compare);
+            std::sort(array.begin(), array.begin() + offset, compare);
         }
 
-        timerDecorator = new SortingTimerDecorator<T>(sortStrategy);
-        timerDecorator->sort(array);
+        T* heap = array.data() + offset;
+        size -= offset;
+        Heap::makeHeap(heap, size, compare);
+
+        for (std::size_t end = size - 1; end > 0; end--) {
+            T value = std::move(heap[end]);
+            heap[end] = std::move(heap[0]);
+            Heap::siftHole(heap, end, 0, value, compare);
+        }
     }
+
+private:
+    typedef DaryHeapOps<T, 4, Compare> Heap;
+
+    Compare compare;
 };
 
-template <typename T>
-SortingFacade<T>* SortingFacade<T>::instance = nullptr;
+class SortWorkerPool {
+public:
+    typedef void (*Task)(void* context, std::size_t index);
 
+    /**
+    * @brief Starts the helper threads. The thread calling run() always works as well.
+    * @param helpers The number of helper threads.
+    */
+    explicit SortWorkerPool(unsigned helpers) : task(nullptr), context(nullptr), count(0), next(0), finished(0),
+        active(0), generation(0), stopping(false) {
+        for (unsigned i = 0; i < helpers; i++) {
+            threads.push_back(std::thread(&SortWorkerPool::work, this));
+        }
+    }
 
+    /**
+    * @brief Stops and joins the helper threads.
+    */
+    ~SortWorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
 
+    /**
+    * @brief Returns the pool the built-in parallel strategies share, with one thread per core.
+    *
+    * Strategy instances are per thread in SortingFacade and SortService, so pools of their own
+    * would multiply the helper threads by the number of callers. The pool starts on first use.
+    */
+    static SortWorkerPool& shared() {
+        static SortWorkerPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    /**
+    * @brief Returns the number of threads that execute tasks, including the caller of run().
+    */
+    unsigned threadCount() const { return static_cast<unsigned>(threads.size()) + 1; }
+
+    /**
+    * @brief Runs task(context, i) for every i in [0, taskCount) and waits until all of them finished.
+    *
+    * Tasks are plain function pointers, so a run does not allocate. Concurrent callers take turns.
+    * A task that starts a run on the same pool, such as a parallel sort inside a parallel join,
+    * executes the inner tasks itself, since the other threads are busy with the outer run.
+    */
+    void run(Task newTask, void* newContext, std::size_t taskCount) {
+        if (drainingPool() == this) {
+            for (std::size_t index = 0; index < taskCount; index++) {
+                newTask(newContext, index);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> turn(runMutex);
+        {
+            // A helper woken for the previous run may only now have copied its task. Wait until it
+            // left drain(), or it would take indices of this run and execute the old task on them.
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [this]() { return active == 0; });
+            task = newTask;
+            context = newContext;
+            count = taskCount;
+            next = 0;
+            finished = 0;
+            generation++;
+        }
+        wake.notify_all();
+
+        drain(newTask, newContext, taskCount);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return finished == count && active == 0; });
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex runMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    Task task;
+    void* context;
+    std::size_t count;
+    std::atomic<std::size_t> next;
+    std::atomic<std::size_t> finished;
+    unsigned active;
+    unsigned generation;
+    bool stopping;
+
+    static SortWorkerPool*& drainingPool() {
+        static thread_local SortWorkerPool* pool = nullptr;
+        return pool;
+    }
+
+    void drain(Task runTask, void* runContext, std::size_t taskCount) {
+        SortWorkerPool* outer = drainingPool();
+        drainingPool() = this;
+        for (std::size_t index = next++; index < taskCount; index = next++) {
+            runTask(runContext, index);
+            finished++;
+        }
+        drainingPool() = outer;
+    }
+
+    void work() {
+        unsigned seen = 0;
+        while (true) {
+            Task runTask;
+            void* runContext;
+            std::size_t taskCount;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen]() { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+
+                seen = generation;
+                runTask = task;
+                runContext = context;
+                taskCount = count;
+                active++;
+            }
+
+            drain(runTask, runContext, taskCount);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                active--;
+            }
+            done.notify_all();
+        }
+    }
+};
+
+template <typename T, typename Compare = std::less<T>>
+class MultiThreadMergeSortStrategy final : public SortStrategy<T> {
+public:
+    /**
+    * @brief Constructs a MultiThreadMergeSortStrategy.
+    * @param compare The ordering to sort by.
+    */
+    explicit MultiThreadMergeSortStrategy(Compare compare = Compare()) : compare(compare) {}
+
+    /**
+     * @brief Sorts the given vector using the Multi-Threaded MergeSort algorithm.
+     *
+     * The vector is cut into one chunk per thread (at least 10000 elements each), the chunks
+     * are merge sorted in parallel and then merged pairwise in parallel rounds. The threads
+     * come from SortWorkerPool::shared(); the merge buffer is created on first use and kept.
+     *
+     * @param array The vector to be sorted.
+     */
+    void sort(std::vector<T>& array) override {
+        size = static_cast<std::ptrdiff_t>(array.size());
+        if (size < 2)
+            return;
+
+        if (buffer.size() < array.size()) {
+            buffer.resize(array.size());
+        }
+        SortWorkerPool& pool = SortWorkerPool::shared();
+
+        current = &array;
+        chunkCount = std::min<std::ptrdiff_t>(pool.threadCount(), (size + sequentialThreshold - 1) / sequentialThreshold);
+        pool.run(&sortChunk, this, chunkCount);
+
+        for (mergeWidth = 1; mergeWidth < chunkCount; mergeWidth *= 2) {
+            pool.run(&mergeChunks, this, (chunkCount + 2 * mergeWidth - 1) / (2 * mergeWidth));
+        }
+        current = nullptr;
+    }
+
+private:
+    static const int sequentialThreshold = 10000;
+
+    Compare compare;
+    std::vector<T> buffer;
+    std::vector<T>* current = nullptr;
+    std::ptrdiff_t size = 0;
+    std::ptrdiff_t chunkCount = 0;
+    std::ptrdiff_t mergeWidth = 0;
+
+    std::ptrdiff_t chunkStart(std::ptrdiff_t chunk) const {
+        return size * chunk / chunkCount;
+    }
+
+    static void sortChunk(void* context, std::size_t index) {
+        MultiThreadMergeSortStrategy* self = static_cast<MultiThreadMergeSortStrategy*>(context);
+        std::ptrdiff_t chunk = static_cast<std::ptrdiff_t>(index);
+        std::ptrdiff_t low = self->chunkStart(chunk);
+        MergeSortStrategy<T, Compare>::sortRange(*self->current, low, self->chunkStart(chunk + 1),
+            self->buffer.data() + low, self->compare);
+    }
+
+    static void mergeChunks(void* context, std::size_t index) {
+        MultiThreadMergeSortStrategy* self = static_cast<MultiThreadMergeSortStrategy*>(context);
+        std::ptrdiff_t first = static_cast<std::ptrdiff_t>(index) * 2 * self->mergeWidth;
+        std::ptrdiff_t middle = first + self->mergeWidth;
+        if (middle >= self->chunkCount)
+            return;
+
+        std::ptrdiff_t last = std::min(first + 2 * self->mergeWidth, self->chunkCount);
+        std::ptrdiff_t low = self->chunkStart(first);
+        MergeKernel<T, Compare>::merge(*self->current, low, self->chunkStart(middle) - 1, self->chunkStart(last) - 1,
+            self->buffer.data() + low, self->compare);
+    }
+};
+
+/**
+    * @brief SortGroupBy template.
+    *
+    * Sorts values and collapses equal keys while sorting instead of in a pass afterwards. It is a
+    * bottom-up merge sort that folds equal keys in its first pass and in every merge, so runs
+    * never hold a key twice and later merge rounds over duplicate-heavy data only touch the
+    * distinct keys.
+    */
+template <typename T, typename Compare = std::less<T>>
+class SortGroupBy {
+public:
+    /**
+    * @brief Constructs a SortGroupBy.
+    * @param compare The ordering to sort by; elements neither orders before the other are one key.
+    */
+    explicit SortGroupBy(Compare compare = Compare()) : compare(compare) {}
+
+    /**
+    * @brief Sorts the given vector and keeps the first element of every key.
+    * @param values The vector to be sorted; it ends up holding the unique keys in order.
+    * @param counts If not null, receives how often each unique key occurred.
+    * @return The number of unique keys.
+    */
+    std::size_t sortUnique(std::vector<T>& values, std::vector<std::size_t>* counts = nullptr) {
+        if (!counts) {
+            return foldSort(values, buffer, compare, [](T&, const T&) {});
+        }
+
+        counted.resize(values.size());
+        for (std::size_t i = 0; i < values.size(); i++) {
+            counted[i].first = values[i];
+            counted[i].second = 1;
+        }
+
+        KeyOrder order = { compare };
+        std::size_t unique = foldSort(counted, countedBuffer, order, [](CountedKey& group, const CountedKey& other) {
+            group.second += other.second;
+        });
+
+        values.resize(unique);
+        counts->resize(unique);
+        for (std::size_t i = 0; i < unique; i++) {
+            values[i] = counted[i].first;
+            (*counts)[i] = counted[i].second;
+        }
+        return unique;
+    }
+
+    /**
+    * @brief Sorts the given records and combines every group of equal keys into one record.
+    * @param records The records to be sorted; they end up holding one record per key, in order.
+    * @param combine Called as combine(group, other) to fold other into group. Groups are folded
+    * in the original order of their records, but other may already hold several combined records,
+    * so combine must be associative. A group starts as the first record with its key.
+    * @return The number of groups.
+    */
+    template <typename Combine>
+    std::size_t sortGroupBy(std::vector<T>& records, Combine combine) {
+        return foldSort(records, buffer, compare, combine);
+    }
+
+private:
+    typedef std::pair<T, std::size_t> CountedKey;
+
+    struct KeyOrder {
+        Compare compare;
+
+        bool operator()(const CountedKey& a, const CountedKey& b) const { return compare(a.first, b.first); }
+    };
+
+    static const std::ptrdiff_t runLength = 16;
+
+    Compare compare;
+    std::vector<T> buffer;
+    std::vector<CountedKey> counted;
+    std::vector<CountedKey> countedBuffer;
+    std::vector<std::ptrdiff_t> runSizes;
+
+    template <typename E, typename Less, typename Fold>
+    std::size_t foldSort(std::vector<E>& values, std::vector<E>& scratch, const Less& less, Fold fold) {
+        std::ptrdiff_t size = static_cast<std::ptrdiff_t>(values.size());
+        if (size == 0)
+            return 0;
+
+        if (scratch.size() < values.size()) {
+            scratch.resize(values.size());
+        }
+        runSizes.resize((size + runLength - 1) / runLength);
+
+        for (std::ptrdiff_t low = 0; low < size; low += runLength) {
+            E* run = values.data() + low;
+            std::ptrdiff_t count = std::min(runLength, size - low);
+            for (std::ptrdiff_t i = 1; i < count; i++) {
+                E key = run[i];
+                std::ptrdiff_t j = i - 1;
+
+                while (j >= 0 && less(key, run[j])) {
+                    run[j + 1] = run[j];
+                    j--;
+                }
+
+                run[j + 1] = key;
+            }
+
+            std::ptrdiff_t groups = 1;
+            for (std::ptrdiff_t i = 1; i < count; i++) {
+                if (less(run[groups - 1], run[i])) {
+                    run[groups++] = run[i];
+                }
+                else {
+                    fold(run[groups - 1], run[i]);
+                }
+            }
+            runSizes[low / runLength] = groups;
+        }
+
+        for (std::ptrdiff_t width = runLength; width < size; width *= 2) {
+            for (std::ptrdiff_t low = 0; low + width < size; low += 2 * width) {
+                const E* left = values.data() + low;
+                const E* leftEnd = left + runSizes[low / runLength];
+                const E* right = values.data() + low + width;
+                const E* rightEnd = right + runSizes[(low + width) / runLength];
+                E* groups = scratch.data() + low;
+                std::ptrdiff_t groupCount = 0;
+
+                groups[groupCount++] = less(*right, *left) ? *right++ : *left++;
+                while (left != leftEnd && right != rightEnd) {
+                    bool takeLeft = !less(*right, *left);
+                    const E* value = takeLeft ? left : right;
+                    left += takeLeft;
+                    right += !takeLeft;
+
+                    if (less(groups[groupCount - 1], *value)) {
+                        groups[groupCount++] = *value;
+                    }
+                    else {
+                        fold(groups[groupCount - 1], *value);
+                    }
+                }
+
+                // Both runs hold every key once, so only the first element of the remaining tail can
+                // still belong to the last group.
+                const E* tail = left != leftEnd ? left : right;
+                const E* tailEnd = left != leftEnd ? leftEnd : rightEnd;
+                if (tail != tailEnd && !less(groups[groupCount - 1], *tail)) {
+                    fold(groups[groupCount - 1], *tail++);
+                }
+                groupCount += std::copy(tail, tailEnd, groups + groupCount) - (groups + groupCount);
+
+                std::copy(groups, groups + groupCount, values.data() + low);
+                runSizes[low / runLength] = groupCount;
+            }
+        }
+
+        values.erase(values.begin() + runSizes[0], values.end());
+        return runSizes[0];
+    }
+};
+
+template <typename T, typename Compare>
+const std::ptrdiff_t SortGroupBy<T, Compare>::runLength;
+
+template <typename T>
+struct SortedRun {
+    const T* first;
+    const T* last;
+
+    SortedRun() : first(nullptr), last(nullptr) {}
+    SortedRun(const T* first, const T* last) : first(first), last(last) {}
+
+    bool empty() const { return first == last; }
+    const T& front() const { return *first; }
+    void pop() { ++first; }
+    std::size_t size() const { return last - first; }
+};
+
+template <typename T, typename Source = SortedRun<T>, typename Compare = std::less<T>>
+class LoserTree {
+public:
+    /**
+    * @brief Builds a tournament tree over the given sorted sources.
+    *
+    * Sources only need empty(), front() and pop(). Equal elements are taken from the
+    * source with the lower index first, so merging through the tree is stable.
+    *
+    * @param sources The sorted sources; they are consumed in place and must outlive the tree.
+    * @param compare The ordering the sources are sorted by.
+    */
+    explicit LoserTree(std::vector<Source>& sources, Compare compare = Compare())
+        : sources(sources), losers(sources.size()), winnerIndex(0), compare(compare) {
+        std::size_t k = sources.size();
+        if (k < 2)
+            return;
+
+        std::vector<std::size_t> winners(2 * k);
+        for (std::size_t i = 0; i < k; i++) {
+            winners[k + i] = i;
+        }
+
+        for (std::size_t node = k - 1; node > 0; node--) {
+            std::size_t a = winners[2 * node];
+            std::size_t b = winners[2 * node + 1];
+            bool aWins = beats(a, b);
+            winners[node] = aWins ? a : b;
+            losers[node] = aWins ? b : a;
+        }
+
+        winnerIndex = winners[1];
+    }
+
+    /**
+    * @brief Checks whether every source is exhausted.
+    */
+    bool empty() const { return sources.empty() || sources[winnerIndex].empty(); }
+
+    /**
+    * @brief Returns the smallest remaining element.
+    * @note The tree must not be empty.
+    */
+    const T& top() const { return sources[winnerIndex].front(); }
+
+    /**
+    * @brief Returns the index of the source holding the smallest remaining element.
+    */
+    std::size_t winner() const { return winnerIndex; }
+
+    /**
+    * @brief Removes the smallest remaining element and replays its path to the root.
+    * @note The tree must not be empty.
+    */
+    void pop() {
+        sources[winnerIndex].pop();
+        replay();
+    }
+
+    /**
+    * @brief Replays the winner's path after its source was advanced from outside the tree.
+    */
+    void replay() {
+        std::size_t k = sources.size();
+        std::size_t candidate = winnerIndex;
+
+        for (std::size_t node = (candidate + k) / 2; node > 0; node /= 2) {
+            if (beats(losers[node], candidate)) {
+                std::swap(losers[node], candidate);
+            }
+        }
+
+        winnerIndex = candidate;
+    }
+
+private:
+    std::vector<Source>& sources;
+    std::vector<std::size_t> losers;
+    std::size_t winnerIndex;
+    Compare compare;
+
+    bool beats(std::size_t a, std::size_t b) const {
+        if (sources[a].empty())
+            return false;
+        if (sources[b].empty())
+            return true;
+        if (compare(sources[a].front(), sources[b].front()))
+            return true;
+        if (compare(sources[b].front(), sources[a].front()))
+            return false;
+        return a < b;
+    }
+};
+
+template <typename T, typename Compare = std::less<T>>
+class KWayMerge {
+public:
+    /**
+    * @brief Merges k sorted runs into the output with about log k comparisons per element.
+    * @param runs The sorted runs.
+    * @param out The output array; must have room for every element and not overlap the runs.
+    * @param compare The ordering the runs are sorted by.
+    */
+    static void merge(const std::vector<SortedRun<T>>& runs, T* out, Compare compare = Compare()) {
+        std::vector<SortedRun<T>> sources(runs);
+        LoserTree<T, SortedRun<T>, Compare> tree(sources, compare);
+
+        while (!tree.empty()) {
+            *out++ = tree.top();
+            tree.pop();
+        }
+    }
+
+    /**
+    * @brief Merges k sorted vectors into a new vector, using parallelMerge() for large inputs.
+    * @param runs The sorted vectors.
+    * @param compare The ordering the vectors are sorted by.
+    * @return The merged elements.
+    */
+    static std::vector<T> merge(const std::vector<std::vector<T>>& runs, Compare compare = Compare()) {
+        std::vector<SortedRun<T>> spans;
+        std::size_t total = 0;
+        for (const auto& run : runs) {
+            spans.push_back(SortedRun<T>(run.data(), run.data() + run.size()));
+            total += run.size();
+        }
+
+        std::vector<T> result(total);
+        parallelMerge(spans, result.data(), 0, compare);
+        return result;
+    }
+
+    /**
+    * @brief Merges k sorted runs on the shared worker pool.
+    *
+    * The output is cut into equal slices and multi-sequence selection finds where every
+    * slice starts in each run, so every pool thread merges an independent part with its own
+    * loser tree. The result is identical to merge().
+    *
+    * @param runs The sorted runs.
+    * @param out The output array; must have room for every element and not overlap the runs.
+    * @param threadCount The number of threads, at most the shared pool's; 0 uses the hardware concurrency.
+    * @param compare The ordering the runs are sorted by.
+    */
+    static void parallelMerge(const std::vector<SortedRun<T>>& runs, T* out, unsigned threadCount = 0, Compare compare = Compare()) {
+        std::size_t total = 0;
+        for (const auto& run : runs) {
+            total += run.size();
+        }
+
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        std::size_t slices = std::min<std::size_t>(threadCount, total / minimumSliceSize);
+        if (slices < 2) {
+            merge(runs, out, compare);
+            return;
+        }
+
+        SortWorkerPool& pool = SortWorkerPool::shared();
+        slices = std::min<std::size_t>(slices, pool.threadCount());
+
+        std::vector<std::vector<std::size_t>> bounds(slices + 1);
+        bounds[0].assign(runs.size(), 0);
+        for (std::size_t i = 1; i < slices; i++) {
+            bounds[i] = splitAt(runs, total * i / slices, compare);
+        }
+        for (const auto& run : runs) {
+            bounds[slices].push_back(run.size());
+        }
+
+        MergeJob job = { &runs, &bounds, out, total, slices, &compare };
+        pool.run(&mergeSlice, &job, slices);
+    }
+
+    /**
+    * @brief Finds how many elements of each run fall into the first `rank` elements of the merged output.
+    * @param runs The sorted runs.
+    * @param rank The output position to split at; at most the total number of elements.
+    * @param compare The ordering the runs are sorted by.
+    * @return One split position per run; the positions add up to rank.
+    */
+    static std::vector<std::size_t> splitAt(const std::vector<SortedRun<T>>& runs, std::size_t rank, Compare compare = Compare()) {
+        std::size_t k = runs.size();
+        std::vector<std::size_t> low(k, 0);
+        std::vector<std::size_t> high(k);
+        std::vector<std::size_t> lower(k);
+        std::vector<std::size_t> upper(k);
+        for (std::size_t j = 0; j < k; j++) {
+            high[j] = runs[j].size();
+        }
+
+        std::vector<std::pair<const T*, std::size_t>> candidates;
+        while (true) {
+            // The weighted median of the active middles discards at least a quarter of the
+            // remaining candidates per round.
+            candidates.clear();
+            std::size_t weight = 0;
+            for (std::size_t j = 0; j < k; j++) {
+                if (low[j] < high[j]) {
+                    std::size_t width = high[j] - low[j];
+                    candidates.push_back(std::make_pair(runs[j].first + low[j] + width / 2, width));
+                    weight += width;
+                }
+            }
+
+            if (candidates.empty())
+                return low;
+
+            std::sort(candidates.begin(), candidates.end(),
+                [&compare](const std::pair<const T*, std::size_t>& a, const std::pair<const T*, std::size_t>& b) {
+                    return compare(*a.first, *b.first);
+                });
+
+            std::size_t median = 0;
+            for (std::size_t seen = 0; 2 * (seen + candidates[median].second) < weight; median++) {
+                seen += candidates[median].second;
+            }
+            const T& pivot = *candidates[median].first;
+
+            std::size_t below = 0;
+            std::size_t belowOrEqual = 0;
+            for (std::size_t j = 0; j < k; j++) {
+                const T* first = runs[j].first;
+                lower[j] = std::lower_bound(first + low[j], first + high[j], pivot, compare) - first;
+                upper[j] = std::upper_bound(first + lower[j], first + high[j], pivot, compare) - first;
+                below += lower[j];
+                belowOrEqual += upper[j];
+            }
+
+            if (rank < below) {
+                high = lower;
+            }
+            else if (rank > belowOrEqual) {
+                low = upper;
+            }
+            else {
+                // Elements equal to the pivot go to the lower-indexed runs first, as in the loser tree.
+                std::size_t remaining = rank - below;
+                for (std::size_t j = 0; j < k; j++) {
+                    std::size_t take = std::min(upper[j] - lower[j], remaining);
+                    lower[j] += take;
+                    remaining -= take;
+                }
+                return lower;
+            }
+        }
+    }
+
+private:
+    static const std::size_t minimumSliceSize = 1 << 16;
+
+    struct MergeJob {
+        const std::vector<SortedRun<T>>* runs;
+        const std::vector<std::vector<std::size_t>>* bounds;
+        T* out;
+        std::size_t total;
+        std::size_t slices;
+        const Compare* compare;
+    };
+
+    static void mergeSlice(void* context, std::size_t index) {
+        const MergeJob& job = *static_cast<const MergeJob*>(context);
+        const std::vector<SortedRun<T>>& runs = *job.runs;
+        const std::vector<std::vector<std::size_t>>& bounds = *job.bounds;
+
+        std::vector<SortedRun<T>> slice;
+        for (std::size_t j = 0; j < runs.size(); j++) {
+            slice.push_back(SortedRun<T>(runs[j].first + bounds[index][j], runs[j].first + bounds[index + 1][j]));
+        }
+        merge(slice, job.out + job.total * index / job.slices, *job.compare);
+    }
+};
+
+struct StringKey {
+    const unsigned char* chars;
+    std::size_t length;
+    std::size_t index;
+};
+
+class StringKeys {
+public:
+    /**
+    * @brief Returns the character at the given depth shifted by one, or 0 past the end of the key.
+    */
+    static int charAt(const StringKey& key, std::size_t depth) {
+        return depth < key.length ? key.chars[depth] + 1 : 0;
+    }
+
+    /**
+    * @brief Returns the length of the common prefix of two keys that already agree on their first `depth` characters.
+    */
+    static std::size_t commonPrefix(const StringKey& a, const StringKey& b, std::size_t depth) {
+        std::size_t limit = std::min(a.length, b.length);
+        while (depth < limit && a.chars[depth] == b.chars[depth]) {
+            depth++;
+        }
+        return depth;
+    }
+
+    /**
+    * @brief Compares two keys that already agree on their first `depth` characters.
+    * @return A negative value, zero or a positive value like memcmp.
+    */
+    static int compare(const StringKey& a, const StringKey& b, std::size_t depth) {
+        std::size_t limit = std::min(a.length, b.length);
+        if (depth < limit) {
+            int result = std::memcmp(a.chars + depth, b.chars + depth, limit - depth);
+            if (result != 0)
+                return result;
+        }
+        return a.length < b.length ? -1 : (a.length > b.length ? 1 : 0);
+    }
+
+    /**
+    * @brief Builds one key per string, pointing at the string's characters.
+    * @param strings The strings; they must not change while the keys are in use.
+    * @param keys Receives the keys.
+    */
+    template <typename T>
+    static void build(const std::vector<T>& strings, std::vector<StringKey>& keys) {
+        keys.resize(strings.size());
+        for (std::size_t i = 0; i < strings.size(); i++) {
+            keys[i].chars = reinterpret_cast<const unsigned char*>(strings[i].data());
+            keys[i].length = strings[i].size();
+            keys[i].index = i;
+        }
+    }
+
+    /**
+    * @brief Moves the strings into the order given by the sorted keys.
+    * @param strings The strings the keys were built from.
+    * @param keys The sorted keys.
+    * @param buffer Scratch vector reused between calls.
+    */
+    template <typename T>
+    static void permute(std::vector<T>& strings, const std::vector<StringKey>& keys, std::vector<T>& buffer) {
+        buffer.clear();
+        buffer.reserve(strings.size());
+        for (const StringKey& key : keys) {
+            buffer.push_back(std::move(strings[key.index]));
+        }
+        strings.swap(buffer);
+    }
+};
+
+class StringSortKernel {
+public:
+    /**
+    * @brief Sorts string keys with multikey quicksort, switching to MSD radix sort for large groups.
+    *
+    * Characters before `depth` are never looked at again, so long common prefixes are
+    * compared once per group instead of once per comparison. Only the smaller groups of
+    * every partition are sorted recursively and the largest one in the loop, so the stack
+    * stays O(log n) frames deep even for keys that are nested prefixes of each other.
+    *
+    * @param keys The keys to sort.
+    * @param count The number of keys.
+    * @param depth The number of leading characters all keys are known to share.
+    */
+    void sort(StringKey* keys, std::size_t count, std::size_t depth) {
+        while (count > 1) {
+            if (count < insertionThreshold) {
+                insertionSort(keys, count, depth);
+                return;
+            }
+
+            if (count >= radixThreshold) {
+                if (!radixSort(keys, count, depth))
+                    depth = groupPrefix(keys, count, depth);
+                continue;
+            }
+
+            int pivot = medianOfThree(StringKeys::charAt(keys[0], depth),
+                StringKeys::charAt(keys[count / 2], depth), StringKeys::charAt(keys[count - 1], depth));
+
+            std::size_t less = 0;
+            std::size_t i = 0;
+            std::size_t greater = count;
+            while (i < greater) {
+                int c = StringKeys::charAt(keys[i], depth);
+                if (c < pivot) {
+                    std::swap(keys[less++], keys[i++]);
+                }
+                else if (c > pivot) {
+                    std::swap(keys[i], keys[--greater]);
+                }
+                else {
+                    i++;
+                }
+            }
+
+            if (less == 0 && greater == count && pivot != 0) {
+                depth = groupPrefix(keys, count, depth + 1);
+                continue;
+            }
+
+            // Keys that ended at the pivot are equal and already in place.
+            Group groups[3] = { { keys, less, depth }, { keys + less, pivot == 0 ? 0 : greater - less, depth + 1 },
+                { keys + greater, count - greater, depth } };
+            std::size_t largest = 0;
+            for (std::size_t g = 1; g < 3; g++) {
+                if (groups[g].count > groups[largest].count)
+                    largest = g;
+            }
+            for (std::size_t g = 0; g < 3; g++) {
+                if (g != largest)
+                    sort(groups[g].keys, groups[g].count, groups[g].depth);
+            }
+
+            keys = groups[largest].keys;
+            count = groups[largest].count;
+            depth = groups[largest].depth;
+        }
+    }
+
+private:
+    static const std::size_t insertionThreshold = 16;
+    static const std::size_t radixThreshold = 4096;
+    static const int alphabetSize = 257;
+
+    struct Group {
+        StringKey* keys;
+        std::size_t count;
+        std::size_t depth;
+    };
+
+    std::vector<StringKey> scratch;
+
+    static int medianOfThree(int a, int b, int c) {
+        if (a < b)
+            return b < c ? b : (a < c ? c : a);
+        return a < c ? a : (b < c ? c : b);
+    }
+
+    // Returns the common prefix length of a group whose keys agree on their first `depth`
+    // characters, so a long shared prefix costs one pass instead of one pass per character.
+    static std::size_t groupPrefix(const StringKey* keys, std::size_t count, std::size_t depth) {
+        // Comparing against the first key cut to the prefix found so far keeps many copies of
+        // one long key from being compared to their full length each.
+        StringKey first = keys[0];
+        for (std::size_t i = 1; i < count && first.length > depth; i++) {
+            first.length = StringKeys::commonPrefix(first, keys[i], depth);
+        }
+        return first.length;
+    }
+
+    static void insertionSort(StringKey* keys, std::size_t count, std::size_t depth) {
+        for (std::size_t i = 1; i < count; i++) {
+            StringKey key = keys[i];
+            std::size_t j = i;
+            while (j > 0 && StringKeys::compare(keys[j - 1], key, depth) > 0) {
+                keys[j] = keys[j - 1];
+                j--;
+            }
+            keys[j] = key;
+        }
+    }
+
+    // Distributes the keys by their character at `depth`, sorts every bucket but the largest
+    // and narrows the arguments to that one for the caller to continue with. Returns false
+    // without moving anything when all keys share that character, so the caller can simply
+    // advance the depth.
+    bool radixSort(StringKey*& keys, std::size_t& count, std::size_t& depth) {
+        std::size_t sizes[alphabetSize] = {};
+        for (std::size_t i = 0; i < count; i++) {
+            sizes[StringKeys::charAt(keys[i], depth)]++;
+        }
+
+        for (int c = 1; c < alphabetSize; c++) {
+            if (sizes[c] == count)
+                return false;
+        }
+
+        std::size_t starts[alphabetSize];
+        std::size_t next[alphabetSize];
+        std::size_t position = 0;
+        for (int c = 0; c < alphabetSize; c++) {
+            starts[c] = position;
+            next[c] = position;
+            position += sizes[c];
+        }
+
+        if (scratch.size() < count)
+            scratch.resize(count);
+        for (std::size_t i = 0; i < count; i++) {
+            scratch[next[StringKeys::charAt(keys[i], depth)]++] = keys[i];
+        }
+        std::copy(scratch.begin(), scratch.begin() + count, keys);
+
+        // Keys that ended before `depth` are equal and stay in bucket 0. Every other bucket
+        // but the largest holds at most half of the keys.
+        int largest = 1;
+        for (int c = 2; c < alphabetSize; c++) {
+            if (sizes[c] > sizes[largest])
+                largest = c;
+        }
+        for (int c = 1; c < alphabetSize; c++) {
+            if (c != largest)
+                sort(keys + starts[c], sizes[c], depth + 1);
+        }
+
+        keys += starts[largest];
+        count = sizes[largest];
+        depth++;
+        return true;
+    }
+};
+
+class LcpMergeSortKernel {
+public:
+    /**
+    * @brief Stable-sorts string keys with an LCP-aware merge sort.
+    *
+    * Every run carries the longest common prefix of each key with its predecessor, so a
+    * merge step only compares characters past the prefix both heads share with the last
+    * output key.
+    *
+    * @param keys The keys to sort.
+    * @param count The number of keys.
+    */
+    void sort(StringKey* keys, std::size_t count) {
+        lcps.assign(count, 0);
+        if (scratchKeys.size() < count) {
+            scratchKeys.resize(count);
+            scratchLcps.resize(count);
+        }
+        sortRange(keys, lcps.data(), count);
+    }
+
+    /**
+    * @brief Returns the LCP of every key with its predecessor from the last sort() call.
+    */
+    const std::vector<std::size_t>& lcpArray() const { return lcps; }
+
+private:
+    static const std::size_t insertionThreshold = 16;
+
+    std::vector<std::size_t> lcps;
+    std::vector<StringKey> scratchKeys;
+    std::vector<std::size_t> scratchLcps;
+
+    void sortRange(StringKey* keys, std::size_t* lcp, std::size_t count) {
+        if (count <= insertionThreshold) {
+            for (std::size_t i = 1; i < count; i++) {
+                StringKey key = keys[i];
+                std::size_t j = i;
+                while (j > 0 && StringKeys::compare(keys[j - 1], key, 0) > 0) {
+                    keys[j] = keys[j - 1];
+                    j--;
+                }
+                keys[j] = key;
+            }
+
+            for (std::size_t i = 1; i < count; i++) {
+                lcp[i] = StringKeys::commonPrefix(keys[i - 1], keys[i], 0);
+            }
+            return;
+        }
+
+        std::size_t half = count / 2;
+        sortRange(keys, lcp, half);
+        sortRange(keys + half, lcp + half, count - half);
+        merge(keys, lcp, half, count);
+    }
+
+    void merge(StringKey* keys, std::size_t* lcp, std::size_t half, std::size_t count) {
+        StringKey* outKeys = scratchKeys.data();
+        std::size_t* outLcp = scratchLcps.data();
+        std::size_t a = 0;
+        std::size_t b = half;
+        std::size_t k = 0;
+
+        // lcpA and lcpB are the common prefixes of each head with the last output key.
+        std::size_t lcpA = 0;
+        std::size_t lcpB = 0;
+
+        while (a < half && b < count) {
+            bool takeA;
+            if (lcpA != lcpB) {
+                takeA = lcpA > lcpB;
+            }
+            else {
+                std::size_t common = StringKeys::commonPrefix(keys[a], keys[b], lcpA);
+                takeA = StringKeys::compare(keys[a], keys[b], common) <= 0;
+                if (takeA)
+                    lcpB = common;
+                else
+                    lcpA = common;
+            }
+
+            if (takeA) {
+                outKeys[k] = keys[a];
+                outLcp[k++] = lcpA;
+                a++;
+                lcpA = a < half ? lcp[a] : 0;
+            }
+            else {
+                outKeys[k] = keys[b];
+                outLcp[k++] = lcpB;
+                b++;
+                lcpB = b < count ? lcp[b] : 0;
+            }
+        }
+
+        while (a < half) {
+            outKeys[k] = keys[a];
+            outLcp[k++] = lcpA;
+            a++;
+            lcpA = a < half ? lcp[a] : 0;
+        }
+
+        while (b < count) {
+            outKeys[k] = keys[b];
+            outLcp[k++] = lcpB;
+            b++;
+            lcpB = b < count ? lcp[b] : 0;
+        }
+
+        std::copy(outKeys, outKeys + count, keys);
+        std::copy(outLcp, outLcp + count, lcp);
+    }
+};
+
+template <typename T>
+class StringSortStrategy : public SortStrategy<T> {
+public:
+    /**
+    * @brief Sorts the given strings with multikey quicksort and MSD radix sort on character keys.
+    * @param array The vector to be sorted.
+    */
+    void sort(std::vector<T>& array) override {
+        StringKeys::build(array, keys);
+        kernel.sort(keys.data(), keys.size(), 0);
+        StringKeys::permute(array, keys, buffer);
+    }
+
+private:
+    std::vector<StringKey> keys;
+    std::vector<T> buffer;
+    StringSortKernel kernel;
+};
+
+template <typename T>
+class StringMergeSortStrategy : public SortStrategy<T> {
+public:
+    /**
+    * @brief Stable-sorts the given strings with an LCP-aware merge sort on character keys.
+    * @param array The vector to be sorted.
+    */
+    void sort(std::vector<T>& array) override {
+        StringKeys::build(array, keys);
+        kernel.sort(keys.data(), keys.size());
+        StringKeys::permute(array, keys, buffer);
+    }
+
+private:
+    std::vector<StringKey> keys;
+    std::vector<T> buffer;
+    LcpMergeSortKernel kernel;
+};
+
+template <typename T>
+class BurstSortStrategy : public SortStrategy<T> {
+public:
+    BurstSortStrategy() : bucketsInUse(0) {}
+
+    /**
+    * @brief Sorts the given strings with burstsort.
+    *
+    * The characters of all strings are copied into one contiguous arena. Keys into the
+    * arena are inserted into a burst trie whose leaves are small buckets; a bucket that
+    * outgrows the cache is burst into a new trie node, unless its keys agree on so many
+    * more characters, as copies of one string do, that bursting would only grow a chain
+    * of single-child nodes. The buckets are then sorted with the multikey kernel and
+    * emitted in trie order.
+    *
+    * @param array The vector to be sorted.
+    */
+    void sort(std::vector<T>& array) override {
+        buildArena(array);
+
+        nodes.clear();
+        freeBuckets.clear();
+        bucketsInUse = 0;
+        nodes.push_back(Node());
+
+        for (const StringKey& key : keys) {
+            insert(key);
+        }
+
+        emit();
+        StringKeys::permute(array, keys, buffer);
+    }
+
+private:
+    static const std::size_t burstThreshold = 2048;
+    static const std::size_t settleLength = 16;
+    static const int alphabetSize = 257;
+
+    // A slot is empty (0), a bucket (b + 1) or a child node (-(n + 1)).
+    struct Node {
+        std::int32_t slots[alphabetSize];
+
+        Node() { std::fill(slots, slots + alphabetSize, 0); }
+    };
+
+    struct EmitFrame {
+        std::size_t node;
+        std::size_t depth;
+        int next;
+    };
+
+    std::vector<unsigned char> arena;
+    std::vector<StringKey> keys;
+    std::vector<T> buffer;
+    std::vector<Node> nodes;
+    std::vector<std::vector<StringKey>> buckets;
+    std::vector<bool> settled;
+    std::vector<std::int32_t> freeBuckets;
+    std::size_t bucketsInUse;
+    std::vector<EmitFrame> frames;
+    StringSortKernel kernel;
+
+    void buildArena(const std::vector<T>& array) {
+        std::size_t total = 0;
+        for (const T& value : array) {
+            total += value.size();
+        }
+
+        arena.resize(total);
+        keys.resize(array.size());
+
+        std::size_t offset = 0;
+        for (std::size_t i = 0; i < array.size(); i++) {
+            std::copy(array[i].begin(), array[i].end(), arena.begin() + offset);
+            keys[i].chars = arena.data() + offset;
+            keys[i].length = array[i].size();
+            keys[i].index = i;
+            offset += array[i].size();
+        }
+    }
+
+    std::int32_t newBucket() {
+        if (!freeBuckets.empty()) {
+            std::int32_t slot = freeBuckets.back();
+            freeBuckets.pop_back();
+            settled[slot - 1] = false;
+            return slot;
+        }
+
+        if (bucketsInUse == buckets.size()) {
+            buckets.push_back(std::vector<StringKey>());
+            settled.push_back(false);
+        }
+
+        buckets[bucketsInUse].clear();
+        settled[bucketsInUse] = false;
+        bucketsInUse++;
+        return static_cast<std::int32_t>(bucketsInUse);
+    }
+
+    void insert(const StringKey& key) {
+        std::size_t node = 0;
+        std::size_t depth = 0;
+
+        while (true) {
+            int c = StringKeys::charAt(key, depth);
+            std::int32_t slot = nodes[node].slots[c];
+
+            if (slot < 0) {
+                node = static_cast<std::size_t>(-(slot + 1));
+                depth++;
+                continue;
+            }
+
+            if (slot == 0) {
+                slot = newBucket();
+                nodes[node].slots[c] = slot;
+            }
+
+            std::vector<StringKey>& bucket = buckets[slot - 1];
+            bucket.push_back(key);
+            if (c != 0 && bucket.size() > burstThreshold && !settled[slot - 1])
+                burst(node, c, depth + 1);
+            return;
+        }
+    }
+
+    void burst(std::size_t node, int c, std::size_t depth) {
+        std::size_t bucket = static_cast<std::size_t>(nodes[node].slots[c] - 1);
+
+        // Bursting keys that agree on the next settleLength characters would move all of them
+        // into one child settleLength times over. The bucket keeps them instead, and the kernel
+        // skips their common prefix in one pass.
+        if (agree(buckets[bucket], depth, depth + settleLength)) {
+            settled[bucket] = true;
+            return;
+        }
+
+        std::size_t child = nodes.size();
+        nodes.push_back(Node());
+        nodes[node].slots[c] = -static_cast<std::int32_t>(child + 1);
+
+        std::vector<StringKey> moved;
+        moved.swap(buckets[bucket]);
+        for (const StringKey& key : moved) {
+            int next = StringKeys::charAt(key, depth);
+            std::int32_t slot = nodes[child].slots[next];
+            if (slot == 0) {
+                slot = newBucket();
+                nodes[child].slots[next] = slot;
+            }
+            buckets[slot - 1].push_back(key);
+        }
+        // Hand the emptied bucket back with its capacity so the next newBucket() reuses it.
+        moved.clear();
+        buckets[bucket].swap(moved);
+        freeBuckets.push_back(static_cast<std::int32_t>(bucket + 1));
+    }
+
+    // Checks whether all keys have the same characters, or end, at every depth in [first, last).
+    static bool agree(const std::vector<StringKey>& bucket, std::size_t first, std::size_t last) {
+        const StringKey& reference = bucket.front();
+        for (const StringKey& key : bucket) {
+            for (std::size_t depth = first; depth < last; depth++) {
+                if (StringKeys::charAt(key, depth) != StringKeys::charAt(reference, depth))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Walks the trie depth-first with an explicit stack of nodes and the next slot to visit in each.
+    void emit() {
+        std::size_t position = 0;
+        frames.clear();
+        frames.push_back(EmitFrame{ 0, 0, 0 });
+
+        while (!frames.empty()) {
+            EmitFrame& frame = frames.back();
+            if (frame.next == alphabetSize) {
+                frames.pop_back();
+                continue;
+            }
+
+            int c = frame.next++;
+            std::size_t depth = frame.depth;
+            std::int32_t slot = nodes[frame.node].slots[c];
+            if (slot < 0) {
+                frames.push_back(EmitFrame{ static_cast<std::size_t>(-(slot + 1)), depth + 1, 0 });
+            }
+            else if (slot > 0) {
+                std::vector<StringKey>& bucket = buckets[slot - 1];
+                if (c != 0)
+                    kernel.sort(bucket.data(), bucket.size(), depth + 1);
+                std::copy(bucket.begin(), bucket.end(), keys.begin() + position);
+                position += bucket.size();
+            }
+        }
+    }
+};
+
+template <typename T, typename Enable = void>
+struct RadixKeyTraits {
+    static const bool enabled = false;
+};
+
+template <typename T>
+struct RadixKeyTraits<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+    static const bool enabled = true;
+
+    /**
+    * @brief Maps the value to an unsigned key with the same order.
+    */
+    static std::uint64_t key(T value) {
+        if (std::is_signed<T>::value)
+            return static_cast<std::uint64_t>(static_cast<std::int64_t>(value)) ^ 0x8000000000000000ull;
+        return static_cast<std::uint64_t>(value);
+    }
+};
+
+template <typename T>
+struct RadixKeyTraits<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static const bool enabled = true;
+
+    /**
+    * @brief Maps the value to an unsigned key with the same order. Negative zero maps to zero and NaNs after positive infinity.
+    */
+    static std::uint64_t key(T value) {
+        double widened = static_cast<double>(value);
+        std::uint64_t bits = 0x7FF8000000000000ull;
+        if (widened == widened) {
+            if (widened == 0.0)
+                widened = 0.0;
+            std::memcpy(&bits, &widened, sizeof(bits));
+        }
+        return (bits & 0x8000000000000000ull) ? ~bits : bits ^ 0x8000000000000000ull;
+    }
+};
+
+/**
+    * @brief CountingSortStrategy template.
+    *
+    * Sorts integers from a small range by counting how often each value occurs and writing the
+    * values back in one sequential pass. The range is the whole type for 1-2 byte types, the one
+    * given to the constructor, or else the minimum and maximum found in the input. Large inputs are
+    * counted in parallel with one histogram per thread.
+    */
+template <typename T>
+class CountingSortStrategy final : public SortStrategy<T> {
+    static_assert(std::is_integral<T>::value, "Counting sort needs integral elements.");
+
+public:
+    /**
+    * @brief Constructs a counting sort over the whole range of T for 1-2 byte types, and over the
+    * range found in each input for wider ones.
+    */
+    CountingSortStrategy() : fixedRange(sizeof(T) <= 2), minimum(std::numeric_limits<T>::min()), maximum(std::numeric_limits<T>::max()) {}
+
+    /**
+    * @brief Constructs a counting sort over a known range.
+    * @param minimum The smallest value the input may hold.
+    * @param maximum The largest value the input may hold.
+    * @throws std::invalid_argument If maximum is smaller than minimum.
+    */
+    CountingSortStrategy(T minimum, T maximum) : fixedRange(true), minimum(minimum), maximum(maximum) {
+        if (maximum < minimum)
+            throw std::invalid_argument("Counting sort range maximum is smaller than its minimum.");
+    }
+
+    /**
+    * @brief Sorts the given vector using counting sort.
+    *
+    * Without a known range, inputs spanning more than max(4n, 65536) values are merge sorted instead.
+    *
+    * @param array The vector to be sorted.
+    * @throws std::out_of_range If a value lies outside the range given to the constructor.
+    */
+    void sort(std::vector<T>& array) override {
+        if (array.size() < 2)
+            return;
+
+        current = &array;
+        low = minimum;
+        if (!fixedRange) {
+            auto bounds = std::minmax_element(array.begin(), array.end());
+            low = *bounds.first;
+            std::uint64_t span = RadixKeyTraits<T>::key(*bounds.second) - RadixKeyTraits<T>::key(low);
+            if (span >= std::max<std::uint64_t>(4 * static_cast<std::uint64_t>(array.size()), 65536)) {
+                fallback.sort(array);
+                return;
+            }
+            width = static_cast<std::size_t>(span) + 1;
+        }
+        else {
+            width = static_cast<std::size_t>(RadixKeyTraits<T>::key(maximum) - RadixKeyTraits<T>::key(minimum)) + 1;
+        }
+
+        chunkCount = 1;
+        if (array.size() >= parallelThreshold && std::thread::hardware_concurrency() > 1) {
+            chunkCount = std::min<std::size_t>(SortWorkerPool::shared().threadCount(), array.size() / (parallelThreshold / 4));
+        }
+
+        counts.assign(chunkCount * width, 0);
+        outOfRange = false;
+        if (chunkCount == 1) {
+            countChunk(this, 0);
+        }
+        else {
+            SortWorkerPool::shared().run(&countChunk, this, chunkCount);
+            for (std::size_t chunk = 1; chunk < chunkCount; chunk++) {
+                const std::size_t* chunkCounts = counts.data() + chunk * width;
+                for (std::size_t value = 0; value < width; value++) {
+                    counts[value] += chunkCounts[value];
+                }
+            }
+        }
+        current = nullptr;
+
+        if (outOfRange)
+            throw std::out_of_range("Counting sort input lies outside the given range.");
+
+        T* out = array.data();
+        std::uint64_t base = static_cast<std::uint64_t>(low);
+        for (std::size_t value = 0; value < width; value++) {
+            out = std::fill_n(out, counts[value], static_cast<T>(base + value));
+        }
+    }
+
+private:
+    static const std::size_t parallelThreshold = 1 << 18;
+
+    bool fixedRange;
+    T minimum;
+    T maximum;
+    T low = T();
+    std::size_t width = 0;
+    std::size_t chunkCount = 0;
+    std::vector<T>* current = nullptr;
+    std::vector<std::size_t> counts;
+    std::atomic<bool> outOfRange;
+    MergeSortStrategy<T> fallback;
+
+    static void countChunk(void* context, std::size_t chunk) {
+        CountingSortStrategy<T>* self = static_cast<CountingSortStrategy<T>*>(context);
+        std::size_t size = self->current->size();
+        const T* first = self->current->data() + size * chunk / self->chunkCount;
+        const T* last = self->current->data() + size * (chunk + 1) / self->chunkCount;
+        std::size_t* histogram = self->counts.data() + chunk * self->width;
+        std::uint64_t lowKey = RadixKeyTraits<T>::key(self->low);
+        std::uint64_t width = self->width;
+
+        bool outside = false;
+        for (; first != last; ++first) {
+            std::uint64_t value = RadixKeyTraits<T>::key(*first) - lowKey;
+            outside |= value >= width;
+            histogram[value < width ? value : 0]++;
+        }
+        if (outside) {
+            self->outOfRange = true;
+        }
+    }
+};
+
+/**
+    * @brief AutoSortStrategy template.
+    *
+    * Picks a strategy per call: counting sort for 1-2 byte integers when the input is large enough
+    * to pay for the histogram, otherwise from a small sample of the input three-way QuickSort when
+    * it shows many repeated keys and MergeSort when it does not.
+    */
+template <typename T, typename Compare = std::less<T>>
+class AutoSortStrategy final : public SortStrategy<T> {
+public:
+    /**
+    * @brief Constructs an AutoSortStrategy.
+    * @param compare The ordering to sort by.
+    */
+    explicit AutoSortStrategy(Compare compare = Compare())
+        : compare(compare), threeWay(compare), mergeSort(compare) {}
+
+    /**
+    * @brief Sorts the given vector with the strategy its sample calls for.
+    * @param array The vector to be sorted.
+    */
+    void sort(std::vector<T>& array) override {
+        if (UsesCounting::value && array.size() >= countingMinimumSize) {
+            counting.sort(array);
+        }
+        else if (duplicateRatio(array) >= duplicateThreshold) {
+            threeWay.sort(array);
+        }
+        else {
+            mergeSort.sort(array);
+        }
+    }
+
+    /**
+    * @brief Estimates the share of elements that repeat an earlier key from an evenly spaced sample.
+    * @param array The vector to sample.
+    * @return A value between 0 (all sampled keys distinct) and nearly 1 (all sampled keys equal).
+    */
+    double duplicateRatio(const std::vector<T>& array) {
+        std::size_t size = array.size();
+        std::size_t count = std::min<std::size_t>(size, sampleSize);
+        if (count < 2)
+            return 0;
+
+        sample.clear();
+        for (std::size_t i = 0; i < count; i++) {
+            sample.push_back(array[i * size / count]);
+        }
+        std::sort(sample.begin(), sample.end(), compare);
+
+        std::size_t repeats = 0;
+        for (std::size_t i = 1; i < count; i++) {
+            repeats += !compare(sample[i - 1], sample[i]);
+        }
+        return static_cast<double>(repeats) / count;
+    }
+
+private:
+    typedef std::integral_constant<bool, std::is_integral<T>::value && !std::is_same<T, bool>::value && sizeof(T) <= 2 &&
+        std::is_same<Compare, std::less<T>>::value> UsesCounting;
+
+    struct NoCountingSort {
+        void sort(std::vector<T>&) {}
+    };
+
+    static const std::size_t sampleSize = 128;
+
+    // A histogram of 2^(8 * sizeof(T)) counters is scanned once per sort; from an eighth of that
+    // many elements on, the scan costs less than comparison sorting them.
+    static const std::size_t countingMinimumSize = (std::size_t(1) << (8 * (sizeof(T) < 2 ? sizeof(T) : 2))) / 8;
+
+    // A uniform sample of 128 keys from n distinct values repeats one with probability of about
+    // 128^2 / 2n, so an eighth of repeats means a few hundred distinct keys or fewer per 1M.
+    static constexpr double duplicateThreshold = 0.125;
+
+    Compare compare;
+    QuickSort3WayStrategy<T, Compare> threeWay;
+    MergeSortStrategy<T, Compare> mergeSort;
+    typename std::conditional<UsesCounting::value, CountingSortStrategy<T>, NoCountingSort>::type counting;
+    std::vector<T> sample;
+};
+
+template <typename T, typename Compare>
+const std::size_t AutoSortStrategy<T, Compare>::sampleSize;
+
+enum class SortOrder {
+    Ascending,
+    Descending
+};
+
+enum class NullOrder {
+    NullsFirst,
+    NullsLast
+};
+
+class NormalizedKeyEncoder {
+public:
+    /**
+    * @brief Starts a new key.
+    */
+    void clear() { key.clear(); }
+
+    /**
+    * @brief Returns the encoded key; keys compare with memcmp (or std::string's operator<) like the columns they encode.
+    */
+    const std::string& bytes() const { return key; }
+
+    /**
+    * @brief Marks the next column as NULL. Nullable columns must be encoded with addNull() or addPresent() in every key.
+    * @param nulls Whether NULLs sort before or after every value.
+    */
+    NormalizedKeyEncoder& addNull(NullOrder nulls = NullOrder::NullsFirst) {
+        key.push_back(nulls == NullOrder::NullsFirst ? '\x00' : '\x01');
+        return *this;
+    }
+
+    /**
+    * @brief Marks the next nullable column as present; its value must be added right after.
+    * @param nulls Whether NULLs sort before or after every value.
+    */
+    NormalizedKeyEncoder& addPresent(NullOrder nulls = NullOrder::NullsFirst) {
+        key.push_back(nulls == NullOrder::NullsFirst ? '\x01' : '\x00');
+        return *this;
+    }
+
+    /**
+    * @brief Appends a 32-bit signed integer column.
+    */
+    NormalizedKeyEncoder& addInt32(std::int32_t value, SortOrder order = SortOrder::Ascending) {
+        return addBigEndian(static_cast<std::uint32_t>(value) ^ 0x80000000u, 4, order);
+    }
+
+    /**
+    * @brief Appends a 64-bit signed integer column.
+    */
+    NormalizedKeyEncoder& addInt64(std::int64_t value, SortOrder order = SortOrder::Ascending) {
+        return addBigEndian(static_cast<std::uint64_t>(value) ^ 0x8000000000000000ull, 8, order);
+    }
+
+    /**
+    * @brief Appends a 64-bit unsigned integer column.
+    */
+    NormalizedKeyEncoder& addUInt64(std::uint64_t value, SortOrder order = SortOrder::Ascending) {
+        return addBigEndian(value, 8, order);
+    }
+
+    /**
+    * @brief Appends a double column. Negative zero sorts as zero and NaNs sort after positive infinity.
+    */
+    NormalizedKeyEncoder& addDouble(double value, SortOrder order = SortOrder::Ascending) {
+        return addBigEndian(RadixKeyTraits<double>::key(value), 8, order);
+    }
+
+    /**
+    * @brief Appends a string column. Zero bytes are escaped and the column is terminated, so shorter strings sort first.
+    */
+    NormalizedKeyEncoder& addString(const std::string& value, SortOrder order = SortOrder::Ascending) {
+        unsigned char mask = order == SortOrder::Descending ? 0xFF : 0x00;
+        for (char c : value) {
+            key.push_back(static_cast<char>(static_cast<unsigned char>(c) ^ mask));
+            if (c == '\0')
+                key.push_back(static_cast<char>(0xFF ^ mask));
+        }
+        key.push_back(static_cast<char>(mask));
+        key.push_back(static_cast<char>(mask));
+        return *this;
+    }
+
+private:
+    std::string key;
+
+    NormalizedKeyEncoder& addBigEndian(std::uint64_t bits, int size, SortOrder order) {
+        if (order == SortOrder::Descending)
+            bits = ~bits;
+
+        for (int shift = 8 * (size - 1); shift >= 0; shift -= 8) {
+            key.push_back(static_cast<char>((bits >> shift) & 0xFF));
+        }
+        return *this;
+    }
+};
+
+class KeyIndexRadixSort {
+public:
+    typedef std::pair<std::uint64_t, std::size_t> Entry;
+
+    /**
+    * @brief Stable LSD radix sort of (key, index) pairs by key, skipping bytes that are equal in every key.
+    * @param entries The pairs to sort.
+    * @param scratch Scratch vector reused between calls.
+    */
+    static void sort(std::vector<Entry>& entries, std::vector<Entry>& scratch) {
+        std::size_t count = entries.size();
+        if (count < 2)
+            return;
+
+        scratch.resize(count);
+        for (int shift = 0; shift < 64; shift += 8) {
+            std::size_t counts[256] = {};
+            for (const Entry& entry : entries) {
+                counts[(entry.first >> shift) & 0xFF]++;
+            }
+
+            if (counts[(entries[0].first >> shift) & 0xFF] == count)
+                continue;
+
+            std::size_t position = 0;
+            for (std::size_t& bucket : counts) {
+                std::size_t size = bucket;
+                bucket = position;
+                position += size;
+            }
+
+            for (const Entry& entry : entries) {
+                scratch[counts[(entry.first >> shift) & 0xFF]++] = entry;
+            }
+            entries.swap(scratch);
+        }
+    }
+};
+
+template <typename Record>
+class NormalizedKeySort {
+public:
+    /**
+    * @brief Sorts records by a composite key without calling a multi-field comparator.
+    *
+    * Every record is encoded once into a memcmp-comparable key. The records are ordered by
+    * an LSD radix sort on the first eight key bytes, and only groups whose prefixes collide
+    * are tie-broken on the full keys with the multikey string kernel.
+    *
+    * @param records The records to sort.
+    * @param encode Called as encode(record, encoder) to append the record's key columns.
+    */
+    template <typename Encode>
+    void sort(std::vector<Record>& records, Encode encode) {
+        std::size_t count = records.size();
+        buildKeys(records, encode);
+
+        prefixes.resize(count);
+        for (std::size_t i = 0; i < count; i++) {
+            prefixes[i] = std::make_pair(prefixOf(keys[i]), i);
+        }
+        KeyIndexRadixSort::sort(prefixes, scratch);
+
+        sorted.resize(count);
+        for (std::size_t i = 0; i < count; i++) {
+            sorted[i] = keys[prefixes[i].second];
+        }
+
+        for (std::size_t first = 0; first < count;) {
+            std::size_t last = first + 1;
+            while (last < count && prefixes[last].first == prefixes[first].first) {
+                last++;
+            }
+            if (last - first > 1)
+                kernel.sort(sorted.data() + first, last - first, 0);
+            first = last;
+        }
+
+        buffer.clear();
+        buffer.reserve(count);
+        for (const StringKey& key : sorted) {
+            buffer.push_back(std::move(records[key.index]));
+        }
+        records.swap(buffer);
+    }
+
+private:
+    NormalizedKeyEncoder encoder;
+    std::vector<unsigned char> arena;
+    std::vector<StringKey> keys;
+    std::vector<KeyIndexRadixSort::Entry> prefixes;
+    std::vector<KeyIndexRadixSort::Entry> scratch;
+    std::vector<StringKey> sorted;
+    std::vector<Record> buffer;
+    StringSortKernel kernel;
+
+    template <typename Encode>
+    void buildKeys(const std::vector<Record>& records, Encode& encode) {
+        std::vector<std::size_t> offsets(records.size() + 1, 0);
+        arena.clear();
+        for (std::size_t i = 0; i < records.size(); i++) {
+            encoder.clear();
+            encode(records[i], encoder);
+            arena.insert(arena.end(), encoder.bytes().begin(), encoder.bytes().end());
+            offsets[i + 1] = arena.size();
+        }
+
+        keys.resize(records.size());
+        for (std::size_t i = 0; i < records.size(); i++) {
+            keys[i].chars = arena.data() + offsets[i];
+            keys[i].length = offsets[i + 1] - offsets[i];
+            keys[i].index = i;
+        }
+    }
+
+    static std::uint64_t prefixOf(const StringKey& key) {
+        std::uint64_t prefix = 0;
+        for (std::size_t i = 0; i < 8; i++) {
+            prefix = (prefix << 8) | (i < key.length ? key.chars[i] : 0);
+        }
+        return prefix;
+    }
+};
+
+/**
+    * @brief SortColumn interface.
+    *
+    * Type-erased view of one column for ColumnarSort. Comparisons already apply the column's sort direction.
+    */
+class SortColumn {
+public:
+    virtual ~SortColumn() {}
+
+    /**
+    * @brief Checks whether radixKey() gives an order-preserving key for this column.
+    */
+    virtual bool hasRadixKey() const = 0;
+
+    /**
+    * @brief Returns an unsigned key whose order matches the column order of the row.
+    */
+    virtual std::uint64_t radixKey(std::size_t row) const = 0;
+
+    /**
+    * @brief Checks whether row a sorts before row b.
+    */
+    virtual bool less(std::size_t a, std::size_t b) const = 0;
+
+    /**
+    * @brief Checks whether rows a and b hold equal values.
+    */
+    virtual bool equal(std::size_t a, std::size_t b) const = 0;
+
+    /**
+    * @brief Reorders the column so that position i holds the value of row permutation[i].
+    */
+    virtual void gather(const std::vector<std::size_t>& permutation) = 0;
+};
+
+template <typename T>
+class TypedSortColumn : public SortColumn {
+public:
+    TypedSortColumn(std::vector<T>& values, SortOrder order) : values(values), descending(order == SortOrder::Descending) {}
+
+    bool hasRadixKey() const override { return RadixKeyTraits<T>::enabled; }
+
+    std::uint64_t radixKey(std::size_t row) const override {
+        return radixKey(row, std::integral_constant<bool, RadixKeyTraits<T>::enabled>());
+    }
+
+    bool less(std::size_t a, std::size_t b) const override {
+        return descending ? before(values[b], values[a]) : before(values[a], values[b]);
+    }
+
+    bool equal(std::size_t a, std::size_t b) const override {
+        return !before(values[a], values[b]) && !before(values[b], values[a]);
+    }
+
+    void gather(const std::vector<std::size_t>& permutation) override {
+        std::vector<T> gathered;
+        gathered.reserve(values.size());
+        for (std::size_t row : permutation) {
+            gathered.push_back(std::move(values[row]));
+        }
+        values.swap(gathered);
+    }
+
+private:
+    std::vector<T>& values;
+    bool descending;
+
+    std::uint64_t radixKey(std::size_t row, std::true_type) const {
+        std::uint64_t key = RadixKeyTraits<T>::key(values[row]);
+        return descending ? ~key : key;
+    }
+
+    std::uint64_t radixKey(std::size_t, std::false_type) const {
+        return 0;
+    }
+
+    // Floating-point values compare like their radix keys, so both sorting paths agree: NaNs come
+    // after everything else and equal each other.
+    static bool before(const T& a, const T& b) {
+        return before(a, b, std::is_floating_point<T>());
+    }
+
+    static bool before(const T& a, const T& b, std::true_type) {
+        return a < b || (b != b && a == a);
+    }
+
+    static bool before(const T& a, const T& b, std::false_type) {
+        return a < b;
+    }
+};
+
+class ColumnarSort {
+public:
+    /**
+    * @brief Adds the next sort key column. Columns are compared in the order they are added.
+    * @param column The column values; reordered in place by sort().
+    * @param order The direction for this column.
+    * @return This object, for chaining.
+    */
+    template <typename T>
+    ColumnarSort& addKeyColumn(std::vector<T>& column, SortOrder order = SortOrder::Ascending) {
+        keyColumns.push_back(std::unique_ptr<SortColumn>(new TypedSortColumn<T>(column, order)));
+        return *this;
+    }
+
+    /**
+    * @brief Adds a column that is not part of the key but must follow the row order.
+    * @param column The column values; reordered in place by sort().
+    * @return This object, for chaining.
+    */
+    template <typename T>
+    ColumnarSort& addPayloadColumn(std::vector<T>& column) {
+        payloadColumns.push_back(std::unique_ptr<SortColumn>(new TypedSortColumn<T>(column, SortOrder::Ascending)));
+        return *this;
+    }
+
+    /**
+    * @brief Computes the sorted row order without touching the columns.
+    *
+    * The first key column orders all rows; every further column only reorders the groups
+    * of rows that are still tied. Large groups of integral or floating-point columns are
+    * radix sorted, everything else is compared directly.
+    *
+    * @param rows The number of rows in every column.
+    * @return The row index for every output position.
+    */
+    std::vector<std::size_t> permutation(std::size_t rows) {
+        std::vector<std::size_t> order(rows);
+        for (std::size_t i = 0; i < rows; i++) {
+            order[i] = i;
+        }
+
+        std::vector<std::pair<std::size_t, std::size_t>> groups;
+        std::vector<std::pair<std::size_t, std::size_t>> tied;
+        if (rows > 1)
+            groups.push_back(std::make_pair(std::size_t(0), rows));
+
+        for (const auto& column : keyColumns) {
+            tied.clear();
+            for (const auto& group : groups) {
+                std::size_t* first = order.data() + group.first;
+                std::size_t count = group.second - group.first;
+
+                if (column->hasRadixKey() && count >= radixThreshold) {
+                    radixSortGroup(*column, first, count);
+                }
+                else {
+                    const SortColumn& keys = *column;
+                    std::sort(first, first + count, [&keys](std::size_t a, std::size_t b) { return keys.less(a, b); });
+                }
+
+                std::size_t start = 0;
+                for (std::size_t i = 1; i <= count; i++) {
+                    if (i == count || !column->equal(first[start], first[i])) {
+                        if (i - start > 1)
+                            tied.push_back(std::make_pair(group.first + start, group.first + i));
+                        start = i;
+                    }
+                }
+            }
+            groups.swap(tied);
+        }
+
+        return order;
+    }
+
+    /**
+    * @brief Sorts every added column by the key columns.
+    * @param rows The number of rows in every column.
+    * @param threadCount The number of threads used to gather the columns, at most the shared pool's;
+    * 0 uses the hardware concurrency.
+    */
+    void sort(std::size_t rows, unsigned threadCount = 0) {
+        std::vector<std::size_t> order = permutation(rows);
+
+        std::vector<SortColumn*> columns;
+        for (const auto& column : keyColumns) {
+            columns.push_back(column.get());
+        }
+        for (const auto& column : payloadColumns) {
+            columns.push_back(column.get());
+        }
+
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        std::size_t workers = std::min<std::size_t>(threadCount, columns.size());
+
+        GatherJob job = { &columns, &order, std::max<std::size_t>(workers, 1) };
+        if (workers > 1) {
+            SortWorkerPool& pool = SortWorkerPool::shared();
+            job.workers = std::min<std::size_t>(workers, pool.threadCount());
+            pool.run(&gatherColumns, &job, job.workers);
+        }
+        else {
+            gatherColumns(&job, 0);
+        }
+    }
+
+private:
+    static const std::size_t radixThreshold = 256;
+
+    struct GatherJob {
+        const std::vector<SortColumn*>* columns;
+        const std::vector<std::size_t>* order;
+        std::size_t workers;
+    };
+
+    // Worker w gathers every workers-th column starting at column w.
+    static void gatherColumns(void* context, std::size_t worker) {
+        const GatherJob& job = *static_cast<const GatherJob*>(context);
+        const std::vector<SortColumn*>& columns = *job.columns;
+        for (std::size_t i = worker; i < columns.size(); i += job.workers) {
+            columns[i]->gather(*job.order);
+        }
+    }
+
+    std::vector<std::unique_ptr<SortColumn>> keyColumns;
+    std::vector<std::unique_ptr<SortColumn>> payloadColumns;
+    std::vector<KeyIndexRadixSort::Entry> entries;
+    std::vector<KeyIndexRadixSort::Entry> scratch;
+
+    void radixSortGroup(const SortColumn& column, std::size_t* rows, std::size_t count) {
+        entries.resize(count);
+        for (std::size_t i = 0; i < count; i++) {
+            entries[i] = std::make_pair(column.radixKey(rows[i]), rows[i]);
+        }
+
+        KeyIndexRadixSort::sort(entries, scratch);
+
+        for (std::size_t i = 0; i < count; i++) {
+            rows[i] = entries[i].second;
+        }
+    }
+};
+
+template <typename T, typename Compare = std::less<T>>
+class SmallSortKernels {
+public:
+    /**
+    * @brief Sorts up to eight elements with a fixed optimal sorting network.
+    * @param values The elements.
+    * @param count The number of elements; at most 8.
+    * @param compare The ordering.
+    */
+    static void sortingNetwork(T* values, std::size_t count, Compare compare = Compare()) {
+        static const unsigned char network2[][2] = { {0, 1} };
+        static const unsigned char network3[][2] = { {0, 2}, {0, 1}, {1, 2} };
+        static const unsigned char network4[][2] = { {0, 2}, {1, 3}, {0, 1}, {2, 3}, {1, 2} };
+        static const unsigned char network5[][2] = {
+            {0, 3}, {1, 4}, {0, 2}, {1, 3}, {0, 1}, {2, 4}, {1, 2}, {3, 4}, {2, 3} };
+        static const unsigned char network6[][2] = {
+            {0, 5}, {1, 3}, {2, 4}, {1, 2}, {3, 4}, {0, 3}, {2, 5}, {0, 1}, {2, 3}, {4, 5}, {1, 2}, {3, 4} };
+        static const unsigned char network7[][2] = {
+            {0, 6}, {2, 3}, {4, 5}, {0, 2}, {1, 4}, {3, 6}, {0, 1}, {2, 5},
+            {3, 4}, {1, 2}, {4, 6}, {2, 3}, {4, 5}, {1, 2}, {3, 4}, {5, 6} };
+        static const unsigned char network8[][2] = {
+            {0, 2}, {1, 3}, {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}, {0, 1}, {2, 3},
+            {4, 5}, {6, 7}, {2, 4}, {3, 5}, {1, 4}, {3, 6}, {1, 2}, {3, 4}, {5, 6} };
+
+        switch (count) {
+        case 2: apply(values, network2, compare); break;
+        case 3: apply(values, network3, compare); break;
+        case 4: apply(values, network4, compare); break;
+        case 5: apply(values, network5, compare); break;
+        case 6: apply(values, network6, compare); break;
+        case 7: apply(values, network7, compare); break;
+        case 8: apply(values, network8, compare); break;
+        default: break;
+        }
+    }
+
+    /**
+    * @brief Sorts the elements with insertion sort.
+    */
+    static void insertionSort(T* values, std::size_t count, Compare compare = Compare()) {
+        for (std::size_t i = 1; i < count; i++) {
+            T key = std::move(values[i]);
+            std::size_t j = i;
+            while (j > 0 && compare(key, values[j - 1])) {
+                values[j] = std::move(values[j - 1]);
+                j--;
+            }
+            values[j] = std::move(key);
+        }
+    }
+
+    /**
+    * @brief Sorts the elements with introsort: median-of-three quicksort that falls back to heapsort
+    * when the recursion gets too deep and to insertion sort for short ranges.
+    */
+    static void introSort(T* values, std::size_t count, Compare compare = Compare()) {
+        std::size_t depthLimit = 0;
+        for (std::size_t n = count; n > 1; n >>= 1) {
+            depthLimit += 2;
+        }
+        introSort(values, count, depthLimit, compare);
+    }
+
+    /**
+    * @brief Sorts the elements with the kernel that suits their count best.
+    */
+    static void sort(T* values, std::size_t count, Compare compare = Compare()) {
+        if (count <= 8)
+            sortingNetwork(values, count, compare);
+        else if (count <= 32)
+            insertionSort(values, count, compare);
+        else
+            introSort(values, count, compare);
+    }
+
+private:
+    static void compareExchange(T* values, std::size_t i, std::size_t j, Compare& compare) {
+        if (compare(values[j], values[i]))
+            std::swap(values[i], values[j]);
+    }
+
+    template <std::size_t Size>
+    static void apply(T* values, const unsigned char (&network)[Size][2], Compare& compare) {
+        for (std::size_t i = 0; i < Size; i++) {
+            compareExchange(values, network[i][0], network[i][1], compare);
+        }
+    }
+
+    static void introSort(T* values, std::size_t count, std::size_t depthLimit, Compare& compare) {
+        while (count > 16) {
+            if (depthLimit == 0) {
+                heapSort(values, count, compare);
+                return;
+            }
+            depthLimit--;
+
+            std::size_t middle = count / 2;
+            compareExchange(values, 0, middle, compare);
+            compareExchange(values, middle, count - 1, compare);
+            compareExchange(values, 0, middle, compare);
+            std::swap(values[middle], values[count - 2]);
+            const T& pivot = values[count - 2];
+
+            std::size_t i = 0;
+            std::size_t j = count - 2;
+            while (true) {
+                while (compare(values[++i], pivot)) {}
+                while (compare(pivot, values[--j])) {}
+                if (i >= j)
+                    break;
+                std::swap(values[i], values[j]);
+            }
+            std::swap(values[i], values[count - 2]);
+
+            // Recurse into the smaller side and loop on the larger one.
+            if (i < count - i - 1) {
+                introSort(values, i, depthLimit, compare);
+                values += i + 1;
+                count -= i + 1;
+            }
+            else {
+                introSort(values + i + 1, count - i - 1, depthLimit, compare);
+                count = i;
+            }
+        }
+        insertionSort(values, count, compare);
+    }
+
+    static void heapSort(T* values, std::size_t count, Compare& compare) {
+        typedef DaryHeapOps<T, 4, Compare> Heap;
+        Heap::makeHeap(values, count, compare);
+        for (std::size_t end = count - 1; end > 0; end--) {
+            T value = std::move(values[end]);
+            values[end] = std::move(values[0]);
+            Heap::siftHole(values, end, 0, value, compare);
+        }
+    }
+};
+
+struct SegmentedSortStats {
+    std::size_t segments;
+    double seconds;
+
+    /**
+    * @brief Returns the throughput of the batch.
+    */
+    double segmentsPerSecond() const { return seconds > 0 ? segments / seconds : 0; }
+};
+
+template <typename T, typename Compare = std::less<T>>
+class SegmentedSort {
+public:
+    /**
+    * @brief Sorts every segment of a flat buffer independently.
+    *
+    * Segments up to 8 elements use sorting networks, up to 32 insertion sort and larger
+    * ones introsort. The threads of SortWorkerPool::shared() receive contiguous runs of
+    * segments with about the same number of elements each.
+    *
+    * @param values The flat buffer holding all segments back to back.
+    * @param offsets The segment boundaries: segment i is [offsets[i], offsets[i + 1]).
+    * @param threadCount The number of threads, at most the shared pool's; 0 uses the hardware concurrency.
+    * @param compare The ordering to sort every segment by.
+    * @return The number of segments and the wall-clock time taken.
+    */
+    static SegmentedSortStats sort(std::vector<T>& values, const std::vector<std::size_t>& offsets, unsigned threadCount = 0,
+        Compare compare = Compare()) {
+        auto start = std::chrono::steady_clock::now();
+        std::size_t segments = offsets.empty() ? 0 : offsets.size() - 1;
+
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        std::size_t total = segments == 0 ? 0 : offsets[segments] - offsets[0];
+        std::size_t workers = std::min<std::size_t>(threadCount, total / minimumElementsPerThread + 1);
+        workers = std::min(workers, std::max<std::size_t>(segments, 1));
+
+        Job job = { values.data(), &offsets, segments, total, workers, &compare };
+        if (workers > 1) {
+            SortWorkerPool& pool = SortWorkerPool::shared();
+            job.workers = std::min<std::size_t>(workers, pool.threadCount());
+            pool.run(&sortShare, &job, job.workers);
+        }
+        else {
+            sortShare(&job, 0);
+        }
+
+        SegmentedSortStats stats;
+        stats.segments = segments;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+private:
+    static const std::size_t minimumElementsPerThread = 1 << 15;
+
+    struct Job {
+        T* values;
+        const std::vector<std::size_t>* offsets;
+        std::size_t segments;
+        std::size_t total;
+        std::size_t workers;
+        const Compare* compare;
+    };
+
+    // Worker w sorts the segments that start in the w-th share of the elements.
+    static void sortShare(void* context, std::size_t worker) {
+        const Job& job = *static_cast<const Job*>(context);
+        sortSegments(job.values, *job.offsets, cut(job, worker), cut(job, worker + 1), *job.compare);
+    }
+
+    static std::size_t cut(const Job& job, std::size_t worker) {
+        if (worker == 0 || worker == job.workers)
+            return worker == 0 ? 0 : job.segments;
+
+        const std::vector<std::size_t>& offsets = *job.offsets;
+        std::size_t boundary = offsets[0] + job.total * worker / job.workers;
+        return std::upper_bound(offsets.begin(), offsets.begin() + job.segments, boundary) - offsets.begin();
+    }
+
+    static void sortSegments(T* values, const std::vector<std::size_t>& offsets, std::size_t first, std::size_t last,
+        const Compare& compare) {
+        for (std::size_t segment = first; segment < last; segment++) {
+            SmallSortKernels<T, Compare>::sort(values + offsets[segment], offsets[segment + 1] - offsets[segment], compare);
+        }
+    }
+};
+
+template <typename T>
+class SortStrategyFactory {
+public:
+    /**
+    * @brief Creates a specific sorting strategy based on the provided algorithm.
+    * @param algorithm The algorithm name.
+    * @return A pointer to the created SortStrategy object, or nullptr if the algorithm is not supported.
+    */
+    static SortStrategy<T>* createSortStrategy(const std::string& algorithm) {
+        if (algorithm == "quicksort") {
+            return new QuickSortStrategy<T>();
+        }
+        else if (algorithm == "mergesort") {
+            return new MergeSortStrategy<T>();
+        }
+        else if (algorithm == "bubblesort") {
+            return new BubbleSortStrategy<T>();
+        }
+        else if (algorithm == "insertionsort") {
+            return new InsertionSortStrategy<T>();
+        }
+        else if (algorithm == "multithreadmergesort") {
+            return new MultiThreadMergeSortStrategy<T>();
+        }
+        else if (algorithm == "heapsort") {
+            return new HeapSortStrategy<T>();
+        }
+        else if (algorithm == "heapsort-fast") {
+            return new FastHeapSortStrategy<T>();
+        }
+        else if (algorithm == "quicksort3way") {
+            return new QuickSort3WayStrategy<T>();
+        }
+        else if (algorithm == "auto") {
+            return new AutoSortStrategy<T>();
+        }
+        else if (algorithm == "countingsort") {
+            return createCountingSortStrategy(std::integral_constant<bool, std::is_integral<T>::value && !std::is_same<T, bool>::value>());
+        }
+        else if (algorithm == "stringsort" || algorithm == "stringmergesort" || algorithm == "burstsort") {
+            return createStringSortStrategy(algorithm, std::is_same<T, std::string>());
+        }
+
+        else {
+            std::cout << "Invalid sorting algorithm." << std::endl;
+        }
+
+        return nullptr;
+    }
+
+private:
+    static SortStrategy<T>* createStringSortStrategy(const std::string& algorithm, std::true_type) {
+        if (algorithm == "stringsort") {
+            return new StringSortStrategy<T>();
+        }
+        else if (algorithm == "burstsort") {
+            return new BurstSortStrategy<T>();
+        }
+        return new StringMergeSortStrategy<T>();
+    }
+
+    static SortStrategy<T>* createStringSortStrategy(const std::string&, std::false_type) {
+        std::cout << "String sorting algorithms need std::string elements." << std::endl;
+        return nullptr;
+    }
+
+    static SortStrategy<T>* createCountingSortStrategy(std::true_type) {
+        return new CountingSortStrategy<T>();
+    }
+
+    static SortStrategy<T>* createCountingSortStrategy(std::false_type) {
+        std::cout << "Counting sort needs integral elements." << std::endl;
+        return nullptr;
+    }
+};
+
+/**
+    * @brief Algorithm tags for compile-time strategy selection.
+    *
+    * Each tag names one comparison sort under the same name SortStrategyFactory accepts and maps it
+    * to its strategy template, so StaticSorter can hold the strategy by value instead of behind a
+    * SortStrategy pointer.
+    */
+struct QuickSortTag {
+    template <typename T, typename Compare> using Strategy = QuickSortStrategy<T, Compare>;
+    static const char* name() { return "quicksort"; }
+};
+
+struct QuickSort3WayTag {
+    template <typename T, typename Compare> using Strategy = QuickSort3WayStrategy<T, Compare>;
+    static const char* name() { return "quicksort3way"; }
+};
+
+struct AutoSortTag {
+    template <typename T, typename Compare> using Strategy = AutoSortStrategy<T, Compare>;
+    static const char* name() { return "auto"; }
+};
+
+struct MergeSortTag {
+    template <typename T, typename Compare> using Strategy = MergeSortStrategy<T, Compare>;
+    static const char* name() { return "mergesort"; }
+};
+
+struct BubbleSortTag {
+    template <typename T, typename Compare> using Strategy = BubbleSortStrategy<T, Compare>;
+    static const char* name() { return "bubblesort"; }
+};
+
+struct InsertionSortTag {
+    template <typename T, typename Compare> using Strategy = InsertionSortStrategy<T, Compare>;
+    static const char* name() { return "insertionsort"; }
+};
+
+struct MultiThreadMergeSortTag {
+    template <typename T, typename Compare> using Strategy = MultiThreadMergeSortStrategy<T, Compare>;
+    static const char* name() { return "multithreadmergesort"; }
+};
+
+struct HeapSortTag {
+    template <typename T, typename Compare> using Strategy = HeapSortStrategy<T, Compare>;
+    static const char* name() { return "heapsort"; }
+};
+
+struct FastHeapSortTag {
+    template <typename T, typename Compare> using Strategy = FastHeapSortStrategy<T, Compare>;
+    static const char* name() { return "heapsort-fast"; }
+};
+
+/**
+    * @brief StaticSorter template.
+    *
+    * Holds the strategy selected by Tag by value. The strategy classes are final, so sort() is a
+    * direct call that the compiler can inline together with the comparator.
+    */
+template <typename Tag, typename T, typename Compare = std::less<T>>
+class StaticSorter {
+public:
+    typedef typename Tag::template Strategy<T, Compare> Strategy;
+
+    /**
+    * @brief Constructs a StaticSorter.
+    * @param compare The ordering to sort by.
+    */
+    explicit StaticSorter(Compare compare = Compare()) : strategy(compare) {}
+
+    /**
+    * @brief Sorts the given vector with the selected strategy.
+    * @param array The vector to be sorted.
+    */
+    void sort(std::vector<T>& array) {
+        strategy.sort(array);
+    }
+
+private:
+    Strategy strategy;
+};
+
+/**
+    * @brief Turns an algorithm name into a compile-time tag once.
+    *
+    * visit() calls the visitor with the tag of the named algorithm, so code that sorts many arrays
+    * can select the strategy at run time and still be compiled against each strategy directly.
+    */
+class StaticSortDispatch {
+public:
+    /**
+    * @brief Calls visitor(Tag()) for the tag of the named comparison sort.
+    * @param algorithm The algorithm name, as accepted by SortStrategyFactory.
+    * @param visitor A generic callable taking any of the tag types.
+    * @return False if the name does not belong to a comparison sort with a tag.
+    */
+    template <typename Visitor>
+    static bool visit(const std::string& algorithm, Visitor&& visitor) {
+        return visitTags<Visitor, QuickSortTag, MergeSortTag, BubbleSortTag, InsertionSortTag,
+            MultiThreadMergeSortTag, HeapSortTag, FastHeapSortTag, QuickSort3WayTag, AutoSortTag>(algorithm, visitor);
+    }
+
+private:
+    template <typename Visitor>
+    static bool visitTags(const std::string&, Visitor&) {
+        return false;
+    }
+
+    template <typename Visitor, typename Tag, typename... Rest>
+    static bool visitTags(const std::string& algorithm, Visitor& visitor) {
+        if (algorithm == Tag::name()) {
+            visitor(Tag());
+            return true;
+        }
+        return visitTags<Visitor, Rest...>(algorithm, visitor);
+    }
+};
+
+template <typename T>
+class SortingTimerDecorator : public SortStrategy<T> {
+private:
+    SortStrategy<T>* strategy;
+    std::ostream* sink;
+
+public:
+    /**
+    * @brief Constructs a SortingTimerDecorator object.
+    * @param strategy The underlying sorting strategy to be decorated.
+    * @param sink The stream the sorting time is written to, or nullptr to only sort.
+    */
+    SortingTimerDecorator(SortStrategy<T>* strategy, std::ostream* sink = &std::cout) : strategy(strategy), sink(sink) {}
+
+    /**
+    * @brief Changes the stream the sorting time is written to.
+    * @param newSink The new stream, or nullptr to only sort.
+    */
+    void setSink(std::ostream* newSink) {
+        sink = newSink;
+    }
+
+    /**
+    * @brief Sorts the given vector using the decorated strategy and measures the sorting time.
+    * @param array The vector to be sorted.
+    */
+    void sort(std::vector<T>& array) override {
+        if (!sink) {
+            strategy->sort(array);
+            return;
+        }
+
+        clock_t startTime = clock();
+        strategy->sort(array);
+        clock_t endTime = clock();
+
+        double timeTaken = double(endTime - startTime) / CLOCKS_PER_SEC;
+        *sink << "Sorting time: " << timeTaken << " seconds" << std::endl;
+    }
+};
+
+template <typename T>
+class SortingFacade {
+private:
+    struct ThreadState {
+        std::unique_ptr<SortStrategy<T>> sortStrategy;
+        std::unique_ptr<SortingTimerDecorator<T>> timerDecorator;
+        std::ostream* timingSink = &std::cout;
+        bool chosen = false;
+        unsigned generation = 0;
+    };
+
+    std::mutex defaultMutex;
+    std::string defaultAlgorithm;
+    std::atomic<unsigned> defaultGeneration;
+
+    SortingFacade() : defaultGeneration(0) {}
+
+    static ThreadState& threadState() {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    static void install(ThreadState& state, const std::string& algorithm) {
+        state.timerDecorator.reset();
+        state.sortStrategy.reset(SortStrategyFactory<T>::createSortStrategy(algorithm));
+        if (state.sortStrategy) {
+            state.timerDecorator.reset(new SortingTimerDecorator<T>(state.sortStrategy.get(), state.timingSink));
+        }
+    }
+
+    void adoptDefault(ThreadState& state) {
+        std::string algorithm;
+        {
+            std::lock_guard<std::mutex> lock(defaultMutex);
+            algorithm = defaultAlgorithm;
+            state.generation = defaultGeneration.load(std::memory_order_relaxed);
+        }
+        install(state, algorithm);
+    }
+
+public:
+    SortingFacade(const SortingFacade&) = delete;
+    SortingFacade& operator=(const SortingFacade&) = delete;
+
+    /**
+    * @brief Returns the singleton instance of SortingFacade.
+    * @return The singleton instance. Creating it is thread-safe.
+    */
+    static SortingFacade<T>* getInstance() {
+        static SortingFacade<T> instance;
+        return &instance;
+    }
+
+    /**
+    * @brief Sets the sorting strategy of the calling thread based on the provided algorithm name.
+    *
+    * The choice is per thread: other threads, including ones started later, keep sorting with
+    * the default strategy, and the calling thread stops following setDefaultSortStrategy(). To
+    * change the strategy of every thread, use setDefaultSortStrategy() instead.
+    *
+    * Every thread owns its strategy and timing decorator, so threads never share mutable sorting
+    * state; only the helper threads of the parallel strategies are shared, through
+    * SortWorkerPool::shared(). The strategy is built here once, so sort() itself does not allocate.
+    *
+    * @param algorithm The algorithm name.
+    */
+    void setSortStrategy(const std::string& algorithm) {
+        ThreadState& state = threadState();
+        install(state, algorithm);
+        state.chosen = true;
+    }
+
+    /**
+    * @brief Sets the sorting strategy used by threads that did not call setSortStrategy().
+    *
+    * Those threads build their own instance of the new strategy on their next sort() call.
+    *
+    * @param algorithm The algorithm name.
+    */
+    void setDefaultSortStrategy(const std::string& algorithm) {
+        std::lock_guard<std::mutex> lock(defaultMutex);
+        defaultAlgorithm = algorithm;
+        defaultGeneration.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+    * @brief Sets the stream sorting times of the calling thread are written to.
+    * @param sink The stream, or nullptr to sort without timing output. Defaults to std::cout.
+    */
+    void setTimingSink(std::ostream* sink) {
+        ThreadState& state = threadState();
+        state.timingSink = sink;
+        if (state.timerDecorator) {
+            state.timerDecorator->setSink(sink);
+        }
+    }
+
+    /**
+    * @brief Sorts the given vector using the sorting strategy of the calling thread.
+    *
+    * Only reads thread-local state and one atomic counter, so concurrent callers do not contend.
+    *
+    * @param array The vector to be sorted.
+    * @note If no sorting strategy is set, an error message will be displayed.
+    */
+    void sort(std::vector<T>& array) {
+        ThreadState& state = threadState();
+        if (!state.chosen && state.generation != defaultGeneration.load(std::memory_order_acquire)) {
+            adoptDefault(state);
+        }
+
+        if (!state.sortStrategy) {
+            std::cout << "Need to set Sorting Strategy." << std::endl;
+            return;
+        }
+
+        state.timerDecorator->sort(array);
+    }
+};
+
+struct SortServiceStats {
+    std::uint64_t submitted;
+    std::uint64_t completed;
+    std::uint64_t rejected;
+    std::uint64_t batches;
+    std::size_t queueDepth;
+    std::size_t maxQueueDepth;
+    double meanLatencySeconds;
+    double p50LatencySeconds;
+    double p99LatencySeconds;
+};
+
+/**
+    * @brief SortService template.
+    *
+    * Sorts vectors asynchronously on a fixed pool of worker threads. Submissions wait in a bounded
+    * priority queue; submit() blocks while it is full and trySubmit() refuses instead. Workers take
+    * consecutive small submissions together as one batch so that tiny sorts do not pay one queue
+    * round trip each. Every worker owns its strategy instances, so workers never share sorting state.
+    */
+template <typename T>
+class SortService {
+public:
+    /**
+    * @brief Starts the worker threads.
+    * @param workerCount The number of worker threads.
+    * @param queueCapacity The number of submissions that may wait at the same time.
+    * @param batchElements The number of elements up to which queued submissions are taken together.
+    */
+    explicit SortService(unsigned workerCount = std::max(1u, std::thread::hardware_concurrency()),
+        std::size_t queueCapacity = 1024, std::size_t batchElements = 4096)
+        : jobs(std::max<std::size_t>(1, queueCapacity)), batchElements(batchElements), sequence(0), maxDepth(0),
+        stopping(false), submittedCount(0), completedCount(0), rejectedCount(0), batchCount(0), totalLatency(0) {
+        for (std::size_t slot = jobs.size(); slot > 0; slot--) {
+            freeSlots.push_back(slot - 1);
+        }
+        for (auto& bucket : latencyBuckets) {
+            bucket = 0;
+        }
+        for (unsigned i = 0; i < std::max(1u, workerCount); i++) {
+            workers.push_back(std::thread(&SortService::work, this));
+        }
+    }
+
+    /**
+    * @brief Finishes the queued submissions and joins the worker threads.
+    */
+    ~SortService() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        notEmpty.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    /**
+    * @brief Queues a sort, waiting while the queue is full.
+    * @param array The vector to be sorted. It must stay alive and untouched until the future is ready.
+    * @param algorithm The algorithm name, as accepted by SortStrategyFactory.
+    * @param priority Higher priorities are started first; equal priorities in submission order.
+    * @return A future that becomes ready when the vector is sorted. It holds std::invalid_argument
+    * for an unknown algorithm name.
+    */
+    std::future<void> submit(std::vector<T>& array, const std::string& algorithm, int priority = 0) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this]() { return !freeSlots.empty(); });
+        return enqueue(lock, array, algorithm, priority);
+    }
+
+    /**
+    * @brief Queues a sort unless the queue is full.
+    * @param array The vector to be sorted. It must stay alive and untouched until the future is ready.
+    * @param algorithm The algorithm name, as accepted by SortStrategyFactory.
+    * @param result Receives the future of the sort when it was queued.
+    * @param priority Higher priorities are started first; equal priorities in submission order.
+    * @return False if the queue was full and nothing was queued.
+    */
+    bool trySubmit(std::vector<T>& array, const std::string& algorithm, std::future<void>& result, int priority = 0) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (freeSlots.empty()) {
+            rejectedCount++;
+            return false;
+        }
+
+        result = enqueue(lock, array, algorithm, priority);
+        return true;
+    }
+
+    /**
+    * @brief Returns the number of submissions waiting for a worker.
+    */
+    std::size_t queueDepth() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size();
+    }
+
+    /**
+    * @brief Returns the counters and the latency from submission to completion so far.
+    *
+    * Percentiles are read from a power-of-two histogram, so they are upper bounds within a factor of two.
+    */
+    SortServiceStats stats() const {
+        SortServiceStats result;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            result.queueDepth = queue.size();
+            result.maxQueueDepth = maxDepth;
+        }
+        result.submitted = submittedCount;
+        result.completed = completedCount;
+        result.rejected = rejectedCount;
+        result.batches = batchCount;
+        result.meanLatencySeconds = result.completed ? totalLatency * 1e-9 / result.completed : 0;
+        result.p50LatencySeconds = latencyPercentile(0.5);
+        result.p99LatencySeconds = latencyPercentile(0.99);
+        return result;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static const int latencyBucketCount = 48;
+
+    struct Job {
+        std::vector<T>* array;
+        std::string algorithm;
+        std::promise<void> done;
+        Clock::time_point submitted;
+    };
+
+    struct QueuedSort {
+        int priority;
+        std::uint64_t sequence;
+        std::size_t slot;
+    };
+
+    struct QueueOrder {
+        bool operator()(const QueuedSort& a, const QueuedSort& b) const {
+            return a.priority != b.priority ? a.priority < b.priority : a.sequence > b.sequence;
+        }
+    };
+
+    typedef std::vector<std::pair<std::string, std::unique_ptr<SortStrategy<T>>>> StrategyCache;
+
+    mutable std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::vector<Job> jobs;
+    std::vector<std::size_t> freeSlots;
+    DaryHeap<QueuedSort, 4, QueueOrder> queue;
+    std::vector<std::thread> workers;
+    std::size_t batchElements;
+    std::uint64_t sequence;
+    std::size_t maxDepth;
+    bool stopping;
+
+    std::atomic<std::uint64_t> submittedCount;
+    std::atomic<std::uint64_t> completedCount;
+    std::atomic<std::uint64_t> rejectedCount;
+    std::atomic<std::uint64_t> batchCount;
+    std::atomic<std::uint64_t> totalLatency;
+    std::atomic<std::uint64_t> latencyBuckets[latencyBucketCount];
+
+    std::future<void> enqueue(std::unique_lock<std::mutex>& lock, std::vector<T>& array, const std::string& algorithm, int priority) {
+        std::size_t slot = freeSlots.back();
+        freeSlots.pop_back();
+
+        Job& job = jobs[slot];
+        job.array = &array;
+        job.algorithm = algorithm;
+        job.done = std::promise<void>();
+        job.submitted = Clock::now();
+        std::future<void> result = job.done.get_future();
+
+        QueuedSort queued = { priority, sequence++, slot };
+        queue.push(queued);
+        maxDepth = std::max(maxDepth, queue.size());
+        submittedCount++;
+
+        lock.unlock();
+        notEmpty.notify_one();
+        return result;
+    }
+
+    void work() {
+        StrategyCache strategies;
+        std::vector<Job> batch;
+
+        while (true) {
+            batch.clear();
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                notEmpty.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+
+                std::size_t elements = 0;
+                do {
+                    std::size_t slot = queue.top().slot;
+                    std::size_t size = jobs[slot].array->size();
+                    if (!batch.empty() && elements + size > batchElements)
+                        break;
+
+                    queue.pop();
+                    elements += size;
+                    batch.push_back(std::move(jobs[slot]));
+                    freeSlots.push_back(slot);
+                } while (!queue.empty() && elements < batchElements);
+            }
+            notFull.notify_all();
+            batchCount++;
+
+            for (auto& job : batch) {
+                run(job, strategies);
+            }
+        }
+    }
+
+    void run(Job& job, StrategyCache& strategies) {
+        SortStrategy<T>* strategy = nullptr;
+        for (auto& cached : strategies) {
+            if (cached.first == job.algorithm) {
+                strategy = cached.second.get();
+                break;
+            }
+        }
+        if (!strategy) {
+            std::unique_ptr<SortStrategy<T>> created(SortStrategyFactory<T>::createSortStrategy(job.algorithm));
+            strategy = created.get();
+            if (strategy) {
+                strategies.push_back(std::make_pair(job.algorithm, std::move(created)));
+            }
+        }
+
+        std::exception_ptr error;
+        if (!strategy) {
+            error = std::make_exception_ptr(std::invalid_argument("Invalid sorting algorithm: " + job.algorithm));
+        }
+        else {
+            try {
+                strategy->sort(*job.array);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        recordLatency(Clock::now() - job.submitted);
+        if (error) {
+            job.done.set_exception(error);
+        }
+        else {
+            job.done.set_value();
+        }
+    }
+
+    void recordLatency(Clock::duration latency) {
+        std::uint64_t nanoseconds = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+        int bucket = 0;
+        while (bucket + 1 < latencyBucketCount && (std::uint64_t(1) << bucket) < nanoseconds) {
+            bucket++;
+        }
+
+        latencyBuckets[bucket]++;
+        totalLatency += nanoseconds;
+        completedCount++;
+    }
+
+    double latencyPercentile(double fraction) const {
+        std::uint64_t total = 0;
+        for (const auto& bucket : latencyBuckets) {
+            total += bucket;
+        }
+        if (total == 0)
+            return 0;
+
+        std::uint64_t rank = static_cast<std::uint64_t>(fraction * (total - 1));
+        std::uint64_t seen = 0;
+        for (int bucket = 0; bucket < latencyBucketCount; bucket++) {
+            seen += latencyBuckets[bucket];
+            if (seen > rank)
+                return (std::uint64_t(1) << bucket) * 1e-9;
+        }
+        return (std::uint64_t(1) << (latencyBucketCount - 1)) * 1e-9;
+    }
+};
+
+enum class JoinType {
+    Inner,
+    Left,
+    Semi,
+    Anti
+};
+
+/**
+    * @brief SortMergeJoin template.
+    *
+    * Joins two key columns by sorting (key, row) pairs of both sides with a registered strategy and
+    * walking them together once, matching whole groups of equal keys. With several threads both
+    * sides are range-partitioned on the same splitter keys first, so every partition is sorted and
+    * joined independently on SortWorkerPool::shared().
+    */
+template <typename Key>
+class SortMergeJoin {
+public:
+    typedef std::pair<Key, std::size_t> Entry;
+    typedef std::pair<std::size_t, std::size_t> Match;
+
+    static const std::size_t noMatch = static_cast<std::size_t>(-1);
+
+    /**
+    * @brief Constructs a join.
+    * @param algorithm The name of the strategy that sorts the (key, row) pairs, as accepted by SortStrategyFactory.
+    * @param threadCount The number of partitions join() splits large inputs into, which the shared worker
+    * pool sorts and joins; 0 uses the hardware concurrency.
+    */
+    explicit SortMergeJoin(const std::string& algorithm = "mergesort", unsigned threadCount = 1)
+        : algorithm(algorithm), threadCount(threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency())) {}
+
+    /**
+    * @brief Joins the rows of two key columns on equal keys and streams the matches.
+    *
+    * Matches come in key order; within a key, by left row and then right row. Inner joins report
+    * every (left, right) pair with equal keys. Left joins also report unmatched left rows with
+    * noMatch as right row. Semi and anti joins report each left row with and without a match
+    * once, with noMatch as right row.
+    *
+    * @param left The keys of the left rows.
+    * @param right The keys of the right rows.
+    * @param type The kind of join.
+    * @param emit Called as emit(leftRow, rightRow) for every match.
+    * @param leftSorted Whether the left keys are already in ascending order, so they need no sort.
+    * @param rightSorted Whether the right keys are already in ascending order, so they need no sort.
+    */
+    template <typename Emit>
+    void forEachMatch(const std::vector<Key>& left, const std::vector<Key>& right, JoinType type, Emit emit,
+        bool leftSorted = false, bool rightSorted = false) {
+        std::vector<Entry> leftEntries = entries(left);
+        std::vector<Entry> rightEntries = entries(right);
+
+        std::unique_ptr<SortStrategy<Entry>> strategy(createStrategy());
+        if (!leftSorted) {
+            strategy->sort(leftEntries);
+        }
+        if (!rightSorted) {
+            strategy->sort(rightEntries);
+        }
+
+        mergeJoin(leftEntries.data(), leftEntries.data() + leftEntries.size(),
+            rightEntries.data(), rightEntries.data() + rightEntries.size(), type, emit);
+    }
+
+    /**
+    * @brief Joins the rows of two key columns on equal keys, in parallel when threads were requested.
+    * @param left The keys of the left rows.
+    * @param right The keys of the right rows.
+    * @param type The kind of join.
+    * @return The matches, in the order forEachMatch() reports them.
+    * @throws std::invalid_argument If the algorithm name is not a strategy for the (key, row) pairs.
+    */
+    std::vector<Match> join(const std::vector<Key>& left, const std::vector<Key>& right, JoinType type) {
+        std::vector<Match> matches;
+        std::size_t partitions = std::min<std::size_t>(threadCount, (left.size() + right.size()) / minimumPartitionSize);
+        if (partitions < 2) {
+            forEachMatch(left, right, type, [&matches](std::size_t leftRow, std::size_t rightRow) {
+                matches.push_back(Match(leftRow, rightRow));
+            });
+            return matches;
+        }
+
+        std::vector<Key> splitters = chooseSplitters(left, right, partitions);
+        std::vector<std::vector<Entry>> leftParts = partition(left, splitters);
+        std::vector<std::vector<Entry>> rightParts = partition(right, splitters);
+
+        std::vector<std::vector<Match>> partMatches(partitions);
+        std::vector<std::exception_ptr> errors(partitions);
+        PartitionJob job = { this, type, &leftParts, &rightParts, &partMatches, &errors };
+        SortWorkerPool::shared().run(&joinPartition, &job, partitions);
+
+        for (auto& error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        std::size_t total = 0;
+        for (const auto& part : partMatches) {
+            total += part.size();
+        }
+        matches.reserve(total);
+        for (const auto& part : partMatches) {
+            matches.insert(matches.end(), part.begin(), part.end());
+        }
+        return matches;
+    }
+
+private:
+    static const std::size_t minimumPartitionSize = 1 << 16;
+    static const std::size_t samplesPerPartition = 64;
+
+    std::string algorithm;
+    unsigned threadCount;
+
+    struct PartitionJob {
+        const SortMergeJoin* join;
+        JoinType type;
+        std::vector<std::vector<Entry>>* leftParts;
+        std::vector<std::vector<Entry>>* rightParts;
+        std::vector<std::vector<Match>>* partMatches;
+        std::vector<std::exception_ptr>* errors;
+    };
+
+    // Sorts and joins one partition; pool tasks must not throw, so errors are kept for join() to rethrow.
+    static void joinPartition(void* context, std::size_t part) {
+        const PartitionJob& job = *static_cast<const PartitionJob*>(context);
+        try {
+            std::vector<Entry>& left = (*job.leftParts)[part];
+            std::vector<Entry>& right = (*job.rightParts)[part];
+            std::unique_ptr<SortStrategy<Entry>> strategy(job.join->createStrategy());
+            strategy->sort(left);
+            strategy->sort(right);
+
+            std::vector<Match>& out = (*job.partMatches)[part];
+            mergeJoin(left.data(), left.data() + left.size(), right.data(), right.data() + right.size(), job.type,
+                [&out](std::size_t leftRow, std::size_t rightRow) { out.push_back(Match(leftRow, rightRow)); });
+        }
+        catch (...) {
+            (*job.errors)[part] = std::current_exception();
+        }
+    }
+
+    SortStrategy<Entry>* createStrategy() const {
+        SortStrategy<Entry>* strategy = SortStrategyFactory<Entry>::createSortStrategy(algorithm);
+        if (!strategy)
+            throw std::invalid_argument("Invalid sorting algorithm for a join: " + algorithm);
+        return strategy;
+    }
+
+    static std::vector<Entry> entries(const std::vector<Key>& keys) {
+        std::vector<Entry> result(keys.size());
+        for (std::size_t row = 0; row < keys.size(); row++) {
+            result[row] = Entry(keys[row], row);
+        }
+        return result;
+    }
+
+    // Evenly spaced samples of both sides; equal splitters only leave some partitions empty.
+    static std::vector<Key> chooseSplitters(const std::vector<Key>& left, const std::vector<Key>& right, std::size_t partitions) {
+        std::vector<Key> sample;
+        std::size_t perSide = partitions * samplesPerPartition;
+        for (const std::vector<Key>* side : { &left, &right }) {
+            std::size_t count = std::min(side->size(), perSide);
+            for (std::size_t i = 0; i < count; i++) {
+                sample.push_back((*side)[i * side->size() / count]);
+            }
+        }
+        std::sort(sample.begin(), sample.end());
+
+        std::vector<Key> splitters;
+        for (std::size_t part = 1; part < partitions; part++) {
+            splitters.push_back(sample[sample.size() * part / partitions]);
+        }
+        return splitters;
+    }
+
+    // Keys below splitters[0] go to the first partition, keys from splitters[i - 1] below splitters[i] to partition i.
+    static std::vector<std::vector<Entry>> partition(const std::vector<Key>& keys, const std::vector<Key>& splitters) {
+        std::vector<std::size_t> targets(keys.size());
+        std::vector<std::size_t> sizes(splitters.size() + 1, 0);
+        for (std::size_t row = 0; row < keys.size(); row++) {
+            targets[row] = std::upper_bound(splitters.begin(), splitters.end(), keys[row]) - splitters.begin();
+            sizes[targets[row]]++;
+        }
+
+        std::vector<std::vector<Entry>> parts(sizes.size());
+        for (std::size_t part = 0; part < parts.size(); part++) {
+            parts[part].reserve(sizes[part]);
+        }
+        for (std::size_t row = 0; row < keys.size(); row++) {
+            parts[targets[row]].push_back(Entry(keys[row], row));
+        }
+        return parts;
+    }
+
+    template <typename Emit>
+    static void mergeJoin(const Entry* left, const Entry* leftEnd, const Entry* right, const Entry* rightEnd, JoinType type, Emit&& emit) {
+        while (left != leftEnd) {
+            while (right != rightEnd && right->first < left->first) {
+                ++right;
+            }
+
+            const Entry* leftGroupEnd = left + 1;
+            while (leftGroupEnd != leftEnd && !(left->first < leftGroupEnd->first)) {
+                ++leftGroupEnd;
+            }
+
+            const Entry* rightGroupEnd = right;
+            while (rightGroupEnd != rightEnd && !(left->first < rightGroupEnd->first)) {
+                ++rightGroupEnd;
+            }
+
+            bool matched = right != rightGroupEnd;
+            for (const Entry* row = left; row != leftGroupEnd; ++row) {
+                if (type == JoinType::Inner || type == JoinType::Left) {
+                    for (const Entry* other = right; other != rightGroupEnd; ++other) {
+                        emit(row->second, other->second);
+                    }
+                    if (!matched && type == JoinType::Left) {
+                        emit(row->second, noMatch);
+                    }
+                }
+                else if (matched == (type == JoinType::Semi)) {
+                    emit(row->second, noMatch);
+                }
+            }
+
+            left = leftGroupEnd;
+            right = rightGroupEnd;
+        }
+    }
+};
+
+template <typename Key>
+const std::size_t SortMergeJoin<Key>::noMatch;
+
+enum class SetOperation {
+    Union,
+    Intersection,
+    Difference
+};
+
+enum class SetKernel {
+    Auto,
+    Merge,
+    Gallop,
+    Simd
+};
+
+/**
+    * @brief SortedSetOps template.
+    *
+    * Unions, intersects and subtracts sorted sets, such as the sorted id lists SortingFacade or
+    * SortGroupBy::sortUnique produce. Inputs of similar size are walked together with a branchless
+    * merge, or for 32-bit integers intersected four at a time with SSE2 compares. When one input
+    * is much smaller, each of its elements gallops (exponential then binary search) through the
+    * larger one, so the cost grows with the small side rather than the large one. With several
+    * threads large inputs are split on keys of the larger input and the slices run on
+    * SortWorkerPool::shared().
+    */
+template <typename T, typename Compare = std::less<T>>
+class SortedSetOps {
+public:
+    /**
+    * @brief Constructs the set operations.
+    * @param threadCount The number of threads large inputs are split across, at most the shared
+    * pool's; 0 uses the hardware concurrency.
+    * @param compare The ordering both inputs are sorted by.
+    */
+    explicit SortedSetOps(unsigned threadCount = 1, Compare compare = Compare())
+        : threadCount(threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency())), compare(compare) {}
+
+    /**
+    * @brief Picks the kernel SetKernel::Auto runs for inputs of the given sizes.
+    * @param operation The set operation.
+    * @param firstSize The number of elements in the first input.
+    * @param secondSize The number of elements in the second input.
+    */
+    static SetKernel chooseKernel(SetOperation operation, std::size_t firstSize, std::size_t secondSize) {
+        std::size_t smaller = std::min(firstSize, secondSize);
+        std::size_t larger = std::max(firstSize, secondSize);
+        if (smaller * gallopRatio <= larger)
+            return SetKernel::Gallop;
+        if (operation == SetOperation::Intersection && UsesSimd::value)
+            return SetKernel::Simd;
+        return SetKernel::Merge;
+    }
+
+    /**
+    * @brief Applies a set operation to two sorted sets.
+    *
+    * Both inputs must be sorted by the comparator and hold no two equivalent elements. Where both
+    * inputs hold an element, the result keeps the one from the first input. SetKernel::Simd only
+    * applies to intersections of 32-bit integers in ascending order and falls back to
+    * SetKernel::Merge otherwise.
+    *
+    * @param operation The set operation; Difference keeps the elements of first that second lacks.
+    * @param first The first sorted set.
+    * @param second The second sorted set.
+    * @param kernel The kernel to run, or SetKernel::Auto to choose by the size ratio.
+    * @return The resulting sorted set.
+    */
+    std::vector<T> apply(SetOperation operation, const std::vector<T>& first, const std::vector<T>& second, SetKernel kernel = SetKernel::Auto) {
+        if (kernel == SetKernel::Auto) {
+            kernel = chooseKernel(operation, first.size(), second.size());
+        }
+        if (kernel == SetKernel::Simd && (operation != SetOperation::Intersection || !UsesSimd::value)) {
+            kernel = SetKernel::Merge;
+        }
+
+        std::vector<T> result;
+        std::size_t larger = std::max(first.size(), second.size());
+        std::size_t slices = std::min<std::size_t>(threadCount, larger / minimumSliceSize);
+        if (slices > 1) {
+            slices = std::min<std::size_t>(slices, SortWorkerPool::shared().threadCount());
+        }
+        if (slices < 2) {
+            result.resize(capacity(operation, first.size(), second.size()));
+            result.resize(run(operation, kernel, first.data(), first.data() + first.size(),
+                second.data(), second.data() + second.size(), result.data()));
+            return result;
+        }
+
+        // Slice the larger input evenly and cut the smaller one at the same keys; equivalent
+        // elements never straddle a cut because neither input holds duplicates.
+        bool firstLarger = first.size() >= second.size();
+        const std::vector<T>& large = firstLarger ? first : second;
+        const std::vector<T>& small = firstLarger ? second : first;
+        std::vector<std::size_t> largeCuts(slices + 1);
+        std::vector<std::size_t> smallCuts(slices + 1);
+        for (std::size_t slice = 0; slice <= slices; slice++) {
+            largeCuts[slice] = large.size() * slice / slices;
+            smallCuts[slice] = slice == 0 ? 0 : slice == slices ? small.size()
+                : std::lower_bound(small.begin(), small.end(), large[largeCuts[slice]], compare) - small.begin();
+        }
+
+        Job job = { this, operation, kernel, &first, &second, firstLarger ? &largeCuts : &smallCuts,
+            firstLarger ? &smallCuts : &largeCuts, std::vector<std::vector<T>>(slices), std::vector<std::size_t>(slices + 1, 0), nullptr };
+        SortWorkerPool::shared().run(&runSlice, &job, slices);
+
+        for (std::size_t slice = 0; slice < slices; slice++) {
+            job.offsets[slice + 1] = job.offsets[slice] + job.parts[slice].size();
+        }
+        result.resize(job.offsets[slices]);
+        job.out = result.data();
+        SortWorkerPool::shared().run(&copySlice, &job, slices);
+        return result;
+    }
+
+    /**
+    * @brief Returns the elements in either sorted set.
+    * @param first The first sorted set.
+    * @param second The second sorted set.
+    * @param kernel The kernel to run, or SetKernel::Auto to choose by the size ratio.
+    */
+    std::vector<T> setUnion(const std::vector<T>& first, const std::vector<T>& second, SetKernel kernel = SetKernel::Auto) {
+        return apply(SetOperation::Union, first, second, kernel);
+    }
+
+    /**
+    * @brief Returns the elements in both sorted sets.
+    * @param first The first sorted set.
+    * @param second The second sorted set.
+    * @param kernel The kernel to run, or SetKernel::Auto to choose by the size ratio.
+    */
+    std::vector<T> setIntersection(const std::vector<T>& first, const std::vector<T>& second, SetKernel kernel = SetKernel::Auto) {
+        return apply(SetOperation::Intersection, first, second, kernel);
+    }
+
+    /**
+    * @brief Returns the elements of the first sorted set that the second one lacks.
+    * @param first The first sorted set.
+    * @param second The second sorted set.
+    * @param kernel The kernel to run, or SetKernel::Auto to choose by the size ratio.
+    */
+    std::vector<T> setDifference(const std::vector<T>& first, const std::vector<T>& second, SetKernel kernel = SetKernel::Auto) {
+        return apply(SetOperation::Difference, first, second, kernel);
+    }
+
+private:
+#if defined(SORTS_HAS_SSE2)
+    typedef std::integral_constant<bool, std::is_integral<T>::value && sizeof(T) == 4 && std::is_same<Compare, std::less<T>>::value> UsesSimd;
+#else
+    typedef std::false_type UsesSimd;
+#endif
+
+    static const std::size_t gallopRatio = 32;
+    static const std::size_t minimumSliceSize = 1 << 16;
+    static const std::size_t simdSlack = 3;
+
+    struct Job {
+        SortedSetOps* self;
+        SetOperation operation;
+        SetKernel kernel;
+        const std::vector<T>* first;
+        const std::vector<T>* second;
+        const std::vector<std::size_t>* firstCuts;
+        const std::vector<std::size_t>* secondCuts;
+        std::vector<std::vector<T>> parts;
+        std::vector<std::size_t> offsets;
+        T* out;
+    };
+
+    unsigned threadCount;
+    Compare compare;
+
+    // The worst-case output size. Intersections get simdSlack more slots, because the SIMD kernel
+    // stores all four elements of a block and only advances past the matches.
+    static std::size_t capacity(SetOperation operation, std::size_t firstSize, std::size_t secondSize) {
+        if (operation == SetOperation::Union)
+            return firstSize + secondSize;
+        if (operation == SetOperation::Intersection)
+            return std::min(firstSize, secondSize) + simdSlack;
+        return firstSize;
+    }
+
+    static void runSlice(void* context, std::size_t slice) {
+        Job* job = static_cast<Job*>(context);
+        const T* first = job->first->data();
+        const T* second = job->second->data();
+        std::size_t firstLow = (*job->firstCuts)[slice];
+        std::size_t firstHigh = (*job->firstCuts)[slice + 1];
+        std::size_t secondLow = (*job->secondCuts)[slice];
+        std::size_t secondHigh = (*job->secondCuts)[slice + 1];
+
+        std::vector<T>& part = job->parts[slice];
+        part.resize(capacity(job->operation, firstHigh - firstLow, secondHigh - secondLow));
+        part.resize(job->self->run(job->operation, job->kernel, first + firstLow, first + firstHigh,
+            second + secondLow, second + secondHigh, part.data()));
+    }
+
+    static void copySlice(void* context, std::size_t slice) {
+        Job* job = static_cast<Job*>(context);
+        std::copy(job->parts[slice].begin(), job->parts[slice].end(), job->out + job->offsets[slice]);
+    }
+
+    std::size_t run(SetOperation operation, SetKernel kernel, const T* first, const T* firstEnd, const T* second, const T* secondEnd, T* out) const {
+        T* end = out;
+        if (kernel == SetKernel::Simd) {
+            end = simdIntersection(first, firstEnd, second, secondEnd, out, UsesSimd());
+        }
+        else if (kernel == SetKernel::Gallop) {
+            bool firstSmaller = firstEnd - first < secondEnd - second;
+            if (operation == SetOperation::Union) {
+                end = firstSmaller ? gallopMerge(second, secondEnd, first, firstEnd, out, true, false)
+                    : gallopMerge(first, firstEnd, second, secondEnd, out, true, true);
+            }
+            else if (operation == SetOperation::Intersection) {
+                end = gallopProbe(first, firstEnd, second, secondEnd, out, firstSmaller, true);
+            }
+            else {
+                end = firstSmaller ? gallopProbe(first, firstEnd, second, secondEnd, out, true, false)
+                    : gallopMerge(first, firstEnd, second, secondEnd, out, false, true);
+            }
+        }
+        else if (operation == SetOperation::Union) {
+            end = mergeUnion(first, firstEnd, second, secondEnd, out);
+        }
+        else if (operation == SetOperation::Intersection) {
+            end = mergeIntersection(first, firstEnd, second, secondEnd, out);
+        }
+        else {
+            end = mergeDifference(first, firstEnd, second, secondEnd, out);
+        }
+        return end - out;
+    }
+
+    // The first element of [first, last) not ordered before value, searched with doubling steps
+    // from the front so that nearby answers cost few comparisons.
+    const T* gallop(const T* first, const T* last, const T& value) const {
+        std::ptrdiff_t size = last - first;
+        std::ptrdiff_t step = 1;
+        std::ptrdiff_t low = 0;
+        while (step <= size && compare(first[step - 1], value)) {
+            low = step;
+            step *= 2;
+        }
+        return std::lower_bound(first + low, first + std::min(step, size), value, compare);
+    }
+
+    // Walks the larger input and looks each element of the smaller one up in it. Keeps the
+    // larger input's elements when keepLarger is set and emits the smaller input's elements that
+    // are missing from it when keepMissing is set. largeIsFirst decides whose copy of a shared
+    // element survives.
+    T* gallopMerge(const T* large, const T* largeEnd, const T* small, const T* smallEnd, T* out, bool keepMissing, bool largeIsFirst) const {
+        for (; small != smallEnd; ++small) {
+            const T* found = gallop(large, largeEnd, *small);
+            out = std::copy(large, found, out);
+            large = found;
+            if (large != largeEnd && !compare(*small, *large)) {
+                if (keepMissing) {
+                    *out++ = largeIsFirst ? *large : *small;
+                }
+                ++large;
+            }
+            else if (keepMissing) {
+                *out++ = *small;
+            }
+        }
+        return std::copy(large, largeEnd, out);
+    }
+
+    // Looks every element of the first input up in the second, or of the second in the first
+    // when probeFirst is false, and emits it when found equals keepFound.
+    T* gallopProbe(const T* first, const T* firstEnd, const T* second, const T* secondEnd, T* out, bool probeFirst, bool keepFound) const {
+        const T* probe = probeFirst ? first : second;
+        const T* probeEnd = probeFirst ? firstEnd : secondEnd;
+        const T* other = probeFirst ? second : first;
+        const T* otherEnd = probeFirst ? secondEnd : firstEnd;
+
+        for (; probe != probeEnd; ++probe) {
+            other = gallop(other, otherEnd, *probe);
+            bool found = other != otherEnd && !compare(*probe, *other);
+            if (found == keepFound) {
+                *out++ = probeFirst ? *probe : *other;
+            }
+            if (found) {
+                ++other;
+            }
+            else if (other == otherEnd && keepFound) {
+                break;
+            }
+        }
+        return out;
+    }
+
+    // The merge kernels advance both sides on flags instead of branching on the comparison, so
+    // interleaved random keys do not mispredict on every step. Their stores may land one slot
+    // past the result but always inside the output, which the caller sized for the worst case.
+    T* mergeUnion(const T* first, const T* firstEnd, const T* second, const T* secondEnd, T* out) const {
+        while (first != firstEnd && second != secondEnd) {
+            bool firstBefore = compare(*first, *second);
+            bool secondBefore = compare(*second, *first);
+            *out++ = secondBefore ? *second : *first;
+            first += !secondBefore;
+            second += !firstBefore;
+        }
+        out = std::copy(first, firstEnd, out);
+        return std::copy(second, secondEnd, out);
+    }
+
+    T* mergeIntersection(const T* first, const T* firstEnd, const T* second, const T* secondEnd, T* out) const {
+        while (first != firstEnd && second != secondEnd) {
+            bool firstBefore = compare(*first, *second);
+            bool secondBefore = compare(*second, *first);
+            *out = *first;
+            out += !firstBefore && !secondBefore;
+            first += !secondBefore;
+            second += !firstBefore;
+        }
+        return out;
+    }
+
+    T* mergeDifference(const T* first, const T* firstEnd, const T* second, const T* secondEnd, T* out) const {
+        while (first != firstEnd && second != secondEnd) {
+            bool firstBefore = compare(*first, *second);
+            bool secondBefore = compare(*second, *first);
+            *out = *first;
+            out += firstBefore;
+            first += !secondBefore;
+            second += !firstBefore;
+        }
+        return std::copy(first, firstEnd, out);
+    }
+
+    T* simdIntersection(const T* first, const T* firstEnd, const T* second, const T* secondEnd, T* out, std::false_type) const {
+        return mergeIntersection(first, firstEnd, second, secondEnd, out);
+    }
+
+#if defined(SORTS_HAS_SSE2)
+    // Compares a block of four from each side against all four rotations of the other, keeps
+    // the matches of the first block and moves on past whichever block ends lower (both when
+    // they end on the same key). Matches are written with unconditional stores, so the output
+    // needs simdSlack spare slots.
+    T* simdIntersection(const T* first, const T* firstEnd, const T* second, const T* secondEnd, T* out, std::true_type) const {
+        while (firstEnd - first >= 4 && secondEnd - second >= 4) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second));
+            __m128i equal = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi32(a, b), _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 3, 2, 1)))),
+                _mm_or_si128(_mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(1, 0, 3, 2))),
+                    _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 1, 0, 3)))));
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(equal));
+
+            *out = first[0];
+            out += mask & 1;
+            *out = first[1];
+            out += (mask >> 1) & 1;
+            *out = first[2];
+            out += (mask >> 2) & 1;
+            *out = first[3];
+            out += (mask >> 3) & 1;
+
+            T firstLast = first[3];
+            T secondLast = second[3];
+            first += firstLast <= secondLast ? 4 : 0;
+            second += secondLast <= firstLast ? 4 : 0;
+        }
+        return mergeIntersection(first, firstEnd, second, secondEnd, out);
+    }
+#endif
+};
+
+/**
+    * @brief LeveledSortedArray template.
+    *
+    * Keeps a growing collection sorted without re-sorting it for every batch of appends. Inserts
+    * are buffered; flushing sorts only the buffer into a new run and merges it with the newest
+    * runs while the older neighbour is less than growthFactor times its size, as the levels of
+    * a log-structured merge tree do. Runs therefore shrink geometrically from the oldest to the
+    * newest, there are O(log n) of them, and every element is merged O(log n) times over its
+    * lifetime. Runs are immutable and shared, so a View taken once stays consistent however
+    * the array changes afterwards, and may be read from other threads.
+    */
+template <typename T, typename Compare = std::less<T>>
+class LeveledSortedArray {
+    typedef std::shared_ptr<const std::vector<T>> Run;
+
+public:
+    /**
+    * @brief A sorted snapshot of the array.
+    */
+    class View {
+    public:
+        /**
+        * @brief Returns the number of elements.
+        */
+        std::size_t size() const { return total; }
+
+        /**
+        * @brief Returns the number of sorted runs lookups search.
+        */
+        std::size_t runCount() const { return runs.size(); }
+
+        /**
+        * @brief Returns the number of elements ordered before the given value.
+        * @param value The value to look up.
+        */
+        std::size_t rank(const T& value) const {
+            std::size_t below = 0;
+            for (const Run& run : runs) {
+                below += std::lower_bound(run->begin(), run->end(), value, compare) - run->begin();
+            }
+            return below;
+        }
+
+        /**
+        * @brief Returns how many elements are equal to the given value.
+        * @param value The value to look up.
+        */
+        std::size_t count(const T& value) const {
+            std::size_t equal = 0;
+            for (const Run& run : runs) {
+                auto range = std::equal_range(run->begin(), run->end(), value, compare);
+                equal += range.second - range.first;
+            }
+            return equal;
+        }
+
+        /**
+        * @brief Checks whether any element is equal to the given value.
+        * @param value The value to look up.
+        */
+        bool contains(const T& value) const {
+            for (const Run& run : runs) {
+                if (std::binary_search(run->begin(), run->end(), value, compare))
+                    return true;
+            }
+            return false;
+        }
+
+        /**
+        * @brief Returns the element at the given position of the sorted order.
+        * @param position The position; must be below size().
+        */
+        const T& at(std::size_t position) const {
+            std::vector<SortedRun<T>> spans = this->spans();
+            std::vector<std::size_t> split = KWayMerge<T, Compare>::splitAt(spans, position, compare);
+
+            const T* best = nullptr;
+            for (std::size_t j = 0; j < spans.size(); j++) {
+                const T* candidate = spans[j].first + split[j];
+                if (candidate != spans[j].last && (!best || compare(*candidate, *best))) {
+                    best = candidate;
+                }
+            }
+            return *best;
+        }
+
+        /**
+        * @brief Calls visit(element) for every element in sorted order.
+        * @param visit The callback.
+        */
+        template <typename Visitor>
+        void forEach(Visitor visit) const {
+            std::vector<SortedRun<T>> sources = spans();
+            LoserTree<T, SortedRun<T>, Compare> tree(sources, compare);
+            while (!tree.empty()) {
+                visit(tree.top());
+                tree.pop();
+            }
+        }
+
+        /**
+        * @brief Copies the elements into a sorted vector, merging large views on several threads.
+        * @param threadCount The number of threads; 0 uses the hardware concurrency.
+        */
+        std::vector<T> toVector(unsigned threadCount = 0) const {
+            std::vector<T> result(total);
+            KWayMerge<T, Compare>::parallelMerge(spans(), result.data(), threadCount, compare);
+            return result;
+        }
+
+    private:
+        friend class LeveledSortedArray;
+
+        std::vector<Run> runs;
+        std::size_t total = 0;
+        Compare compare;
+
+        std::vector<SortedRun<T>> spans() const {
+            std::vector<SortedRun<T>> result;
+            for (const Run& run : runs) {
+                result.push_back(SortedRun<T>(run->data(), run->data() + run->size()));
+            }
+            return result;
+        }
+    };
+
+    /**
+    * @brief Constructs an empty array.
+    * @param algorithm The name of the strategy that sorts each buffered batch, as accepted by SortStrategyFactory.
+    * @param growthFactor How many times larger than the next newer run a run must be to be left alone; at least 2.
+    * @param compare The ordering to keep the elements in; with anything but std::less<T>, only the
+    * comparison sorts StaticSortDispatch knows can sort the batches.
+    * @throws std::invalid_argument If the algorithm name is not a strategy for T and the comparator.
+    */
+    explicit LeveledSortedArray(const std::string& algorithm = "mergesort", std::size_t growthFactor = 2, Compare compare = Compare())
+        : strategy(createStrategy(algorithm, compare, std::is_same<Compare, std::less<T>>())),
+          growthFactor(std::max<std::size_t>(growthFactor, 2)), compare(compare) {
+        if (!strategy)
+            throw std::invalid_argument("Invalid sorting algorithm: " + algorithm);
+    }
+
+    /**
+    * @brief Buffers one element.
+    * @param value The element.
+    */
+    void insert(const T& value) {
+        pending.push_back(value);
+    }
+
+    /**
+    * @brief Buffers a batch of elements.
+    * @param first The first element of the batch.
+    * @param last One past the last element of the batch.
+    */
+    template <typename Iterator>
+    void insert(Iterator first, Iterator last) {
+        pending.insert(pending.end(), first, last);
+    }
+
+    /**
+    * @brief Sorts the buffered elements into a new run and merges the levels it overfills.
+    */
+    void flush() {
+        if (pending.empty())
+            return;
+
+        strategy->sort(pending);
+        total += pending.size();
+        std::shared_ptr<std::vector<T>> merged = std::make_shared<std::vector<T>>();
+        merged->swap(pending);
+
+        while (!runs.empty() && runs.back()->size() < growthFactor * merged->size()) {
+            const std::vector<T>& older = *runs.back();
+            std::shared_ptr<std::vector<T>> combined = std::make_shared<std::vector<T>>(older.size() + merged->size());
+            MergeKernel<T, Compare>::mergeRuns(older.data(), older.size(), merged->data(), merged->size(), combined->data(), compare);
+            merged = combined;
+            runs.pop_back();
+        }
+
+        runs.push_back(merged);
+    }
+
+    /**
+    * @brief Merges every run into one, so later views search a single array.
+    * @param threadCount The number of threads; 0 uses the hardware concurrency.
+    */
+    void compact(unsigned threadCount = 0) {
+        flush();
+        if (runs.size() < 2)
+            return;
+
+        View all = view();
+        runs.assign(1, std::make_shared<const std::vector<T>>(all.toVector(threadCount)));
+    }
+
+    /**
+    * @brief Flushes the buffer and returns a snapshot that later changes do not affect.
+    */
+    View view() {
+        flush();
+        View snapshot;
+        snapshot.runs = runs;
+        snapshot.total = total;
+        snapshot.compare = compare;
+        return snapshot;
+    }
+
+    /**
+    * @brief Returns the number of elements, including buffered ones.
+    */
+    std::size_t size() const { return total + pending.size(); }
+
+    /**
+    * @brief Returns the number of sorted runs, not counting the buffer.
+    */
+    std::size_t runCount() const { return runs.size(); }
+
+private:
+    std::unique_ptr<SortStrategy<T>> strategy;
+    std::size_t growthFactor;
+    Compare compare;
+    std::vector<Run> runs;
+    std::vector<T> pending;
+    std::size_t total = 0;
+
+    struct StrategyCreator {
+        const Compare& compare;
+        SortStrategy<T>*& created;
+
+        template <typename Tag>
+        void operator()(Tag) const {
+            created = new typename Tag::template Strategy<T, Compare>(compare);
+        }
+    };
+
+    static SortStrategy<T>* createStrategy(const std::string& algorithm, const Compare&, std::true_type) {
+        return SortStrategyFactory<T>::createSortStrategy(algorithm);
+    }
+
+    static SortStrategy<T>* createStrategy(const std::string& algorithm, const Compare& compare, std::false_type) {
+        SortStrategy<T>* created = nullptr;
+        StrategyCreator creator = { compare, created };
+        StaticSortDispatch::visit(algorithm, creator);
+        return created;
+    }
+};
+
+struct AsyncIoOptions {
+    bool enabled = true;
+    std::size_t blockBytes = 1 << 20;
+    unsigned depth = 2;
+    unsigned threads = 2;
+    bool directIo = false;
+};
+
+struct AsyncIoStats {
+    const char* backend = "stdio";
+    std::uint64_t requests = 0;
+    std::uint64_t bytesRead = 0;
+    std::uint64_t bytesWritten = 0;
+    double ioSeconds = 0;
+    double stallSeconds = 0;
+
+    /**
+    * @brief Returns the fraction of busy I/O time the caller did not spend waiting, 1 when I/O fully overlapped computation.
+    *
+    * ioSeconds is wall time with at least one request outstanding, so parallel requests count once.
+    */
+    double overlap() const {
+        return ioSeconds > 0 ? std::max(0.0, 1 - stallSeconds / ioSeconds) : 1;
+    }
+};
+
+#if defined(SORTS_HAS_POSIX_IO)
+/**
+    * @brief AsyncIoService class.
+    *
+    * Runs positional file reads and writes in the background and hands out tickets to wait on.
+    * With SORTS_USE_IO_URING on Linux, requests go through an io_uring set up with raw system
+    * calls and one thread collects the completions; otherwise, or when the kernel refuses the
+    * ring, a few threads run pread and pwrite. Submitting and waiting must happen on one thread.
+    * The statistics count the wall time during which at least one request was outstanding as
+    * I/O time and the time wait() blocked as stall time.
+    */
+class AsyncIoService {
+public:
+    /**
+    * @brief Starts the service.
+    * @param threads The number of pread/pwrite threads if io_uring is not used.
+    * @param queueDepth The number of requests the ring keeps in flight.
+    */
+    explicit AsyncIoService(unsigned threads = 2, unsigned queueDepth = 32) : stopping(false), outstanding(0) {
+#if defined(SORTS_HAS_IO_URING)
+        ring.reset(new Ring());
+        if (ring->open(std::max(queueDepth, 2u))) {
+            current.backend = "io_uring";
+            workers.push_back(std::thread(&AsyncIoService::reapCompletions, this));
+            return;
+        }
+        ring.reset();
+#else
+        (void)queueDepth;
+#endif
+        current.backend = "threads";
+        for (unsigned i = 0; i < std::max(threads, 1u); i++) {
+            workers.push_back(std::thread(&AsyncIoService::work, this));
+        }
+    }
+
+    /**
+    * @brief Waits for the requests in flight and stops the threads.
+    */
+    ~AsyncIoService() {
+        for (std::size_t ticket = 0; ticket < requests.size(); ticket++) {
+            if (requests[ticket].busy) {
+                complete(ticket);
+            }
+        }
+        bool reaperStuck = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping = true;
+#if defined(SORTS_HAS_IO_URING)
+            if (ring && ringFailure == 0) {
+                ring->pushStop();
+                reaperStuck = submitToRing(lock) != 0;
+            }
+#endif
+        }
+        wake.notify_all();
+#if defined(SORTS_HAS_IO_URING)
+        if (reaperStuck) {
+            // The reaper only wakes up for the stop no-op. Nothing is in flight any more, so it is
+            // left blocked in the kernel together with the ring it waits on.
+            workers.back().detach();
+            workers.pop_back();
+            ring.release();
+        }
+#else
+        (void)reaperStuck;
+#endif
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    /**
+    * @brief Returns "io_uring" or "threads".
+    */
+    const char* backend() const { return current.backend; }
+
+    /**
+    * @brief Starts reading bytes at an offset of a file. Short reads happen only at the end of the file.
+    * @param fd The file descriptor.
+    * @param buffer Room for the bytes; must stay valid until the request is waited on.
+    * @param bytes The number of bytes to read.
+    * @param offset The file offset to read at.
+    * @return The ticket to wait on.
+    */
+    std::size_t submitRead(int fd, void* buffer, std::size_t bytes, std::uint64_t offset) {
+        return submit(fd, false, static_cast<char*>(buffer), bytes, offset);
+    }
+
+    /**
+    * @brief Starts writing bytes at an offset of a file.
+    * @param fd The file descriptor.
+    * @param buffer The bytes; must stay valid until the request is waited on.
+    * @param bytes The number of bytes to write.
+    * @param offset The file offset to write at.
+    * @return The ticket to wait on.
+    */
+    std::size_t submitWrite(int fd, const void* buffer, std::size_t bytes, std::uint64_t offset) {
+        return submit(fd, true, const_cast<char*>(static_cast<const char*>(buffer)), bytes, offset);
+    }
+
+    /**
+    * @brief Waits for a request and frees its ticket.
+    * @param ticket The ticket a submit call returned.
+    * @return The number of bytes transferred.
+    * @throws std::runtime_error If the request failed.
+    */
+    std::size_t wait(std::size_t ticket) {
+        bool write = requests[ticket].write;
+        std::ptrdiff_t result = complete(ticket);
+        if (result < 0)
+            throw std::runtime_error(std::string(write ? "Asynchronous write failed: " : "Asynchronous read failed: ") + std::strerror(static_cast<int>(-result)));
+        return static_cast<std::size_t>(result);
+    }
+
+    /**
+    * @brief Waits for a request and frees its ticket without throwing, for cleanup paths.
+    * @param ticket The ticket a submit call returned.
+    * @return The number of bytes transferred, or the negated errno value.
+    */
+    std::ptrdiff_t complete(std::size_t ticket) {
+        Request& request = requests[ticket];
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&request]() { return request.done; });
+        }
+
+        // The ring may stop a transfer short of the full length, a buffered read for instance when
+        // only part of the range was cached; finish it in place unless a read reached the end.
+        std::ptrdiff_t result = request.result;
+        bool shortWrite = request.write && result >= 0 && static_cast<std::size_t>(result) < request.bytes;
+        bool shortRead = !request.write && result > 0 && static_cast<std::size_t>(result) < request.bytes
+            && !endOfFile(request.fd, request.offset + result);
+        if (shortWrite || shortRead) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                beginIo();
+            }
+            std::ptrdiff_t rest = transfer(request.fd, request.write, request.buffer + result, request.bytes - result, request.offset + result);
+            result = rest < 0 ? rest : result + rest;
+            std::lock_guard<std::mutex> lock(mutex);
+            endIo();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        current.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (result > 0) {
+            (request.write ? current.bytesWritten : current.bytesRead) += result;
+        }
+        request.busy = false;
+        freeTickets.push_back(ticket);
+        return result;
+    }
+
+    /**
+    * @brief Returns the statistics so far.
+    */
+    AsyncIoStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        AsyncIoStats snapshot = current;
+        if (outstanding > 0) {
+            snapshot.ioSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - busySince).count();
+        }
+        return snapshot;
+    }
+
+private:
+    struct Request {
+        int fd = -1;
+        bool write = false;
+        char* buffer = nullptr;
+        std::size_t bytes = 0;
+        std::uint64_t offset = 0;
+        struct iovec vector;
+        std::ptrdiff_t result = 0;
+        bool done = false;
+        bool busy = false;
+        bool inRing = false;
+    };
+
+    // Requests live in a deque so that the ring and the threads can keep pointers to them.
+    std::deque<Request> requests;
+    std::vector<std::size_t> freeTickets;
+    std::deque<std::size_t> pending;
+    std::vector<std::thread> workers;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    bool stopping;
+    AsyncIoStats current;
+    unsigned outstanding;
+    std::chrono::steady_clock::time_point busySince;
+
+    std::size_t submit(int fd, bool write, char* buffer, std::size_t bytes, std::uint64_t offset) {
+        std::size_t ticket;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (freeTickets.empty()) {
+                ticket = requests.size();
+                requests.emplace_back();
+            }
+            else {
+                ticket = freeTickets.back();
+                freeTickets.pop_back();
+            }
+
+            Request& request = requests[ticket];
+            request.fd = fd;
+            request.write = write;
+            request.buffer = buffer;
+            request.bytes = bytes;
+            request.offset = offset;
+            request.vector.iov_base = buffer;
+            request.vector.iov_len = bytes;
+            request.result = 0;
+            request.done = false;
+            request.busy = true;
+            current.requests++;
+            beginIo();
+        }
+
+#if defined(SORTS_HAS_IO_URING)
+        if (ring) {
+            // A request the ring refuses, or that comes after the reaper failed, completes right
+            // away with the error, so that waiting on it reports the error instead of hanging.
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [this]() { return !ring->full() || ringFailure != 0; });
+            int error = ringFailure;
+            if (error == 0) {
+                ring->push(requests[ticket], ticket);
+                error = submitToRing(lock);
+            }
+            if (error == 0) {
+                requests[ticket].inRing = true;
+            }
+            else {
+                finish(requests[ticket], -error);
+            }
+            return ticket;
+        }
+#endif
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(ticket);
+        }
+        wake.notify_one();
+        return ticket;
+    }
+
+    // Returns the bytes moved or -errno. A short read is re-issued for the rest unless it returned
+    // nothing or reached the file size: the read after the last byte would start at an unaligned
+    // offset, which O_DIRECT refuses.
+    static std::ptrdiff_t transfer(int fd, bool write, char* buffer, std::size_t bytes, std::uint64_t offset) {
+        std::size_t moved = 0;
+        while (moved < bytes) {
+            if (!write && moved > 0 && endOfFile(fd, offset + moved))
+                break;
+
+            ssize_t result = write ? ::pwrite(fd, buffer + moved, bytes - moved, static_cast<off_t>(offset + moved))
+                : ::pread(fd, buffer + moved, bytes - moved, static_cast<off_t>(offset + moved));
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result < 0)
+                return -errno;
+            if (result == 0 && !write)
+                break;
+            moved += static_cast<std::size_t>(result);
+        }
+        return static_cast<std::ptrdiff_t>(moved);
+    }
+
+    static bool endOfFile(int fd, std::uint64_t offset) {
+        struct stat status;
+        return ::fstat(fd, &status) == 0 && offset >= static_cast<std::uint64_t>(status.st_size);
+    }
+
+    // I/O time runs while the number of outstanding requests is above zero. Called with the lock held.
+    void beginIo() {
+        if (outstanding++ == 0) {
+            busySince = std::chrono::steady_clock::now();
+        }
+    }
+
+    void endIo() {
+        if (--outstanding == 0) {
+            current.ioSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - busySince).count();
+        }
+    }
+
+    void finish(Request& request, std::ptrdiff_t result) {
+        request.result = result;
+        request.done = true;
+        request.inRing = false;
+        endIo();
+    }
+
+    void work() {
+        while (true) {
+            Request* request;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !pending.empty(); });
+                if (pending.empty())
+                    return;
+
+                request = &requests[pending.front()];
+                pending.pop_front();
+            }
+
+            std::ptrdiff_t result = transfer(request->fd, request->write, request->buffer, request->bytes, request->offset);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finish(*request, result);
+            }
+            finished.notify_all();
+        }
+    }
+
+#if defined(SORTS_HAS_IO_URING)
+    class Ring {
+    public:
+        Ring() : fd(-1), inFlight(0) {}
+
+        ~Ring() {
+            if (fd < 0)
+                return;
+            ::munmap(sqes, entries * sizeof(io_uring_sqe));
+            if (cqMemory != sqMemory) {
+                ::munmap(cqMemory, cqSize);
+            }
+            ::munmap(sqMemory, sqSize);
+            ::close(fd);
+        }
+
+        bool isOpen() const { return fd >= 0; }
+
+        bool open(unsigned depth) {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            int ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, depth, &params));
+            if (ringFd < 0)
+                return false;
+
+            sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (singleMap) {
+                sqSize = cqSize = std::max(sqSize, cqSize);
+            }
+
+            sqMemory = ::mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+            cqMemory = singleMap ? sqMemory
+                : ::mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+            void* sqeMemory = ::mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+            if (sqMemory == MAP_FAILED || cqMemory == MAP_FAILED || sqeMemory == MAP_FAILED) {
+                if (sqeMemory != MAP_FAILED) ::munmap(sqeMemory, params.sq_entries * sizeof(io_uring_sqe));
+                if (cqMemory != MAP_FAILED && cqMemory != sqMemory) ::munmap(cqMemory, cqSize);
+                if (sqMemory != MAP_FAILED) ::munmap(sqMemory, sqSize);
+                ::close(ringFd);
+                return false;
+            }
+
+            char* sq = static_cast<char*>(sqMemory);
+            char* cq = static_cast<char*>(cqMemory);
+            sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+            sqes = static_cast<io_uring_sqe*>(sqeMemory);
+            entries = params.sq_entries;
+            fd = ringFd;
+            return true;
+        }
+
+        bool full() const { return inFlight == entries; }
+
+        // Queues one request for submit(); the ring must not be full.
+        void push(Request& request, std::size_t ticket) {
+            io_uring_sqe& entry = nextEntry();
+            entry.opcode = request.write ? IORING_OP_WRITEV : IORING_OP_READV;
+            entry.fd = request.fd;
+            entry.off = request.offset;
+            entry.addr = reinterpret_cast<std::uint64_t>(&request.vector);
+            entry.len = 1;
+            entry.user_data = ticket;
+        }
+
+        // Queues a no-op whose completion tells the reaping thread to stop.
+        void pushStop() {
+            io_uring_sqe& entry = nextEntry();
+            entry.opcode = IORING_OP_NOP;
+            entry.user_data = stopTicket;
+        }
+
+        // Hands the entry queued last to the kernel; returns 0 or the errno value. A refused entry
+        // is taken back out of the ring, so submit() may be called again to retry it.
+        int submit() {
+            __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+            while (::syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0) < 0) {
+                if (errno != EINTR) {
+                    int error = errno;
+                    __atomic_store_n(sqTail, *sqTail - 1, __ATOMIC_RELEASE);
+                    return error;
+                }
+            }
+            inFlight++;
+            return 0;
+        }
+
+        // Blocks for at least one completion and calls done(ticket, result) for every one. Sets
+        // stopped once the stop no-op completed; returns 0 or the errno value waiting failed with.
+        template <typename Done>
+        int reap(Done done, bool& stopped) {
+            unsigned head = *cqHead;
+            std::chrono::microseconds pause(50);
+            while (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                if (::syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) >= 0 || errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EBUSY)
+                    return errno;
+                std::this_thread::sleep_for(pause);
+                pause = std::min(pause * 2, std::chrono::microseconds(10000));
+            }
+
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                const io_uring_cqe& completion = cqes[head & cqMask];
+                std::size_t ticket = static_cast<std::size_t>(completion.user_data);
+                if (ticket == stopTicket) {
+                    stopped = true;
+                }
+                else {
+                    done(ticket, static_cast<std::ptrdiff_t>(completion.res));
+                }
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            return 0;
+        }
+
+        // Called with the service lock held, like push().
+        void completed() { inFlight--; }
+
+    private:
+        static const std::size_t stopTicket = static_cast<std::size_t>(-1);
+
+        int fd;
+        unsigned inFlight;
+        unsigned entries = 0;
+        std::size_t sqSize = 0;
+        std::size_t cqSize = 0;
+        void* sqMemory = nullptr;
+        void* cqMemory = nullptr;
+        unsigned* sqTail = nullptr;
+        unsigned sqMask = 0;
+        unsigned* sqArray = nullptr;
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned cqMask = 0;
+        io_uring_cqe* cqes = nullptr;
+        io_uring_sqe* sqes = nullptr;
+
+        io_uring_sqe& nextEntry() {
+            unsigned index = *sqTail & sqMask;
+            std::memset(&sqes[index], 0, sizeof(io_uring_sqe));
+            sqArray[index] = index;
+            return sqes[index];
+        }
+    };
+
+    std::unique_ptr<Ring> ring;
+    int ringFailure = 0;
+
+    // Submits the entry pushed last. While the kernel is short of resources or the completion
+    // queue is full, it retries with a growing pause that releases the lock for the reaper.
+    int submitToRing(std::unique_lock<std::mutex>& lock) {
+        std::chrono::microseconds pause(50);
+        while (true) {
+            int error = ring->submit();
+            if (error != EAGAIN && error != EBUSY)
+                return error;
+            if (ringFailure != 0)
+                return ringFailure;
+            finished.wait_for(lock, pause);
+            pause = std::min(pause * 2, std::chrono::microseconds(10000));
+        }
+    }
+
+    void reapCompletions() {
+        bool stopped = false;
+        while (!stopped) {
+            int error = ring->reap([this](std::size_t ticket, std::ptrdiff_t result) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finish(requests[ticket], result);
+                    ring->completed();
+                }
+                finished.notify_all();
+            }, stopped);
+
+            if (error != 0) {
+                // Nothing would complete the requests in the ring any more; fail them and every
+                // later one rather than leave their waiters blocked.
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ringFailure = error;
+                    for (auto& request : requests) {
+                        if (request.inRing) {
+                            finish(request, -error);
+                            ring->completed();
+                        }
+                    }
+                }
+                finished.notify_all();
+                return;
+            }
+        }
+    }
+#endif
+};
+
+/**
+    * @brief AlignedIoBuffer class.
+    *
+    * A byte buffer whose start and size are multiples of the block alignment that O_DIRECT needs.
+    */
+class AlignedIoBuffer {
+public:
+    static const std::size_t alignment = 4096;
+
+    explicit AlignedIoBuffer(std::size_t bytes) : length(roundUp(bytes)), storage(new char[length + alignment]) {
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(storage.get());
+        start = storage.get() + (alignment - address % alignment) % alignment;
+    }
+
+    char* data() const { return start; }
+    std::size_t size() const { return length; }
+
+    static std::size_t roundUp(std::size_t bytes) {
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+
+private:
+    std::size_t length;
+    std::unique_ptr<char[]> storage;
+    char* start;
+};
+
+/**
+    * @brief AsyncFileReader class.
+    *
+    * Reads a file sequentially with depth blocks in flight: while the caller works on one block,
+    * the next ones are already being read, so with two blocks the file is double-buffered.
+    */
+class AsyncFileReader {
+public:
+    /**
+    * @brief Starts reading ahead.
+    * @param io The service that runs the reads.
+    * @param fd The file descriptor; it is not closed.
+    * @param offset The file offset to start at; must be block-aligned for O_DIRECT files.
+    * @param blockBytes The size of every read, rounded up to the buffer alignment.
+    * @param depth The number of blocks in flight; at least 2.
+    */
+    AsyncFileReader(AsyncIoService& io, int fd, std::uint64_t offset, std::size_t blockBytes, unsigned depth)
+        : io(io), fd(fd), nextOffset(offset), current(0), handedOut(false), endOfFile(false) {
+        for (unsigned i = 0; i < std::max(depth, 2u); i++) {
+            blocks.push_back(Block(blockBytes));
+        }
+        for (auto& block : blocks) {
+            issue(block);
+        }
+    }
+
+    ~AsyncFileReader() {
+        for (auto& block : blocks) {
+            if (block.inFlight) {
+                io.complete(block.ticket);
+            }
+        }
+    }
+
+    /**
+    * @brief Returns the next block of the file.
+    * @param data Set to the bytes, valid until the next call.
+    * @return The number of bytes, 0 at the end of the file.
+    * @throws std::runtime_error If a read failed.
+    */
+    std::size_t next(const char*& data) {
+        if (handedOut) {
+            issue(blocks[current]);
+            current = (current + 1) % blocks.size();
+            handedOut = false;
+        }
+
+        Block& block = blocks[current];
+        if (!block.inFlight)
+            return 0;
+
+        block.inFlight = false;
+        // The service finishes short reads in the middle of the file, so a short block is the last.
+        std::size_t bytes = io.wait(block.ticket);
+        if (bytes < block.buffer.size()) {
+            endOfFile = true;
+        }
+        data = block.buffer.data();
+        handedOut = true;
+        return bytes;
+    }
+
+private:
+    struct Block {
+        explicit Block(std::size_t bytes) : buffer(bytes), ticket(0), inFlight(false) {}
+
+        AlignedIoBuffer buffer;
+        std::size_t ticket;
+        bool inFlight;
+    };
+
+    AsyncIoService& io;
+    int fd;
+    std::uint64_t nextOffset;
+    std::vector<Block> blocks;
+    std::size_t current;
+    bool handedOut;
+    bool endOfFile;
+
+    void issue(Block& block) {
+        if (endOfFile)
+            return;
+
+        block.ticket = io.submitRead(fd, block.buffer.data(), block.buffer.size(), nextOffset);
+        block.inFlight = true;
+        nextOffset += block.buffer.size();
+    }
+};
+
+/**
+    * @brief AsyncFileWriter class.
+    *
+    * Writes a file sequentially behind the caller: a filled block is submitted and the caller
+    * moves on to the next free one, waiting only when all depth blocks are still being written.
+    */
+class AsyncFileWriter {
+public:
+    /**
+    * @brief Prepares the write-behind blocks.
+    * @param io The service that runs the writes.
+    * @param fd The file descriptor; it is not closed.
+    * @param blockBytes The size of every write, rounded up to the buffer alignment.
+    * @param depth The number of blocks in flight; at least 2.
+    * @param direct Whether the file was opened with O_DIRECT, so the last block is padded and the file truncated.
+    */
+    AsyncFileWriter(AsyncIoService& io, int fd, std::size_t blockBytes, unsigned depth, bool direct)
+        : io(io), fd(fd), direct(direct), offset(0), current(0), filled(0) {
+        for (unsigned i = 0; i < std::max(depth, 2u); i++) {
+            blocks.push_back(Block(blockBytes));
+        }
+    }
+
+    ~AsyncFileWriter() {
+        for (auto& block : blocks) {
+            if (block.inFlight) {
+                io.complete(block.ticket);
+            }
+        }
+    }
+
+    /**
+    * @brief Appends bytes to the file.
+    * @param data The bytes.
+    * @param bytes The number of bytes.
+    * @throws std::runtime_error If an earlier write failed.
+    */
+    void append(const void* data, std::size_t bytes) {
+        const char* source = static_cast<const char*>(data);
+        while (bytes != 0) {
+            Block& block = blocks[current];
+            if (block.inFlight) {
+                block.inFlight = false;
+                io.wait(block.ticket);
+            }
+
+            std::size_t take = std::min(bytes, block.buffer.size() - filled);
+            std::memcpy(block.buffer.data() + filled, source, take);
+            filled += take;
+            source += take;
+            bytes -= take;
+            if (filled == block.buffer.size()) {
+                submit(filled);
+            }
+        }
+    }
+
+    /**
+    * @brief Writes the partial last block and waits for every write.
+    * @throws std::runtime_error If a write failed.
+    */
+    void finish() {
+        std::uint64_t size = offset + filled;
+        if (filled != 0) {
+            Block& block = blocks[current];
+            if (block.inFlight) {
+                block.inFlight = false;
+                io.wait(block.ticket);
+            }
+            std::size_t bytes = direct ? AlignedIoBuffer::roundUp(filled) : filled;
+            std::memset(block.buffer.data() + filled, 0, bytes - filled);
+            submit(bytes);
+        }
+
+        for (auto& block : blocks) {
+            if (block.inFlight) {
+                block.inFlight = false;
+                io.wait(block.ticket);
+            }
+        }
+        if (direct && offset != size && ::ftruncate(fd, static_cast<off_t>(size)) != 0)
+            throw std::runtime_error(std::string("Truncating a file failed: ") + std::strerror(errno));
+    }
+
+private:
+    struct Block {
+        explicit Block(std::size_t bytes) : buffer(bytes), ticket(0), inFlight(false) {}
+
+        AlignedIoBuffer buffer;
+        std::size_t ticket;
+        bool inFlight;
+    };
+
+    AsyncIoService& io;
+    int fd;
+    bool direct;
+    std::uint64_t offset;
+    std::vector<Block> blocks;
+    std::size_t current;
+    std::size_t filled;
+
+    void submit(std::size_t bytes) {
+        Block& block = blocks[current];
+        block.ticket = io.submitWrite(fd, block.buffer.data(), bytes, offset);
+        block.inFlight = true;
+        offset += bytes;
+        current = (current + 1) % blocks.size();
+        filled = 0;
+    }
+};
+#else
+class AsyncIoService;
+#endif
+
+enum class RunGeneration {
+    Auto,
+    ReplacementSelection,
+    LoadSortStore
+};
+
+struct ExternalRunStats {
+    RunGeneration method = RunGeneration::Auto;
+    std::size_t runCount = 0;
+    std::uint64_t elementsRead = 0;
+    std::uint64_t bytesWritten = 0;
+    double sortedness = 0;
+    AsyncIoStats io;
+
+    /**
+    * @brief Returns how many merge passes over the data the runs need with the given fan-in.
+    * @param fanIn The number of runs one merge reads at once; at least 2.
+    */
+    std::size_t mergePasses(std::size_t fanIn) const {
+        std::size_t passes = 0;
+        for (std::size_t runs = runCount; runs > 1; runs = (runs + fanIn - 1) / fanIn) {
+            passes++;
+        }
+        return passes;
+    }
+};
+
+/**
+    * @brief ExternalRunGenerator template.
+    *
+    * Forms the sorted runs of an external sort from a binary file of elements, using a memory
+    * budget for the workspace. Load-sort-store fills the workspace, sorts it and writes it out,
+    * giving runs of exactly the budget. Replacement selection keeps the workspace as a 4-ary
+    * min-heap, writes the smallest element and admits each new one to the current run when it
+    * does not precede the last one written, or parks it for the next run otherwise. That gives
+    * runs of about twice the budget on random input and a single run on sorted input, so the
+    * merge needs fewer passes. The automatic choice samples the first workspace load: nearly
+    * sorted data uses replacement selection, and so does random data unless the input size shows
+    * that load-sort-store runs already fit into one merge, where the cheaper sort wins; mostly
+    * descending data, on which replacement selection gains nothing, uses load-sort-store.
+    */
+template <typename T, typename Compare = std::less<T>>
+class ExternalRunGenerator {
+    static_assert(std::is_trivially_copyable<T>::value, "Run files hold raw element bytes.");
+
+public:
+    /**
+    * @brief Constructs a run generator.
+    * @param memoryElements The workspace budget in elements; the I/O blocks set by setIoOptions() come on top.
+    * @param pathPrefix The prefix of the run file paths; run i is written to pathPrefix + i + ".run".
+    * @param method How to form runs.
+    * @param fanIn The merge fan-in the automatic choice assumes.
+    * @param compare The ordering to sort by.
+    */
+    ExternalRunGenerator(std::size_t memoryElements, const std::string& pathPrefix, RunGeneration method = RunGeneration::Auto,
+        std::size_t fanIn = 64, Compare compare = Compare())
+        : memoryElements(std::max<std::size_t>(memoryElements, 1)), pathPrefix(pathPrefix), method(method),
+        fanIn(std::max<std::size_t>(fanIn, 2)), compare(compare), sorter(compare) {}
+
+    /**
+    * @brief Sets how run generation reads and writes files.
+    *
+    * By default reads run ahead and writes run behind the sort through an AsyncIoService with
+    * two blocks per file, double-buffering disk and CPU. Builds without POSIX file I/O and
+    * inputs that cannot be read at an offset, such as pipes, use blocking stdio instead.
+    *
+    * @param options The block size, blocks in flight per file, fallback threads and whether to use O_DIRECT.
+    */
+    void setIoOptions(const AsyncIoOptions& options) { ioOptions = options; }
+
+    /**
+    * @brief Reads the input to its end and writes it as sorted runs.
+    * @param input A binary file of elements, opened for reading; it is left at its end.
+    * @return The paths of the run files in the order they were written.
+    * @throws std::runtime_error If a run file cannot be created or written, or reading fails. The
+    * run files written up to then are removed.
+    */
+    std::vector<std::string> generate(std::FILE* input) {
+        std::uint64_t inputElements = remainingElements(input);
+#if defined(SORTS_HAS_POSIX_IO)
+        std::int64_t offset = tell(input);
+        if (ioOptions.enabled && offset >= 0) {
+            AsyncIoService service(ioOptions.threads);
+            BlockReader reader(service, ::fileno(input), static_cast<std::uint64_t>(offset), ioOptions, runStats.io);
+            generate(reader, inputElements, &service);
+            seek(input, 0, SEEK_END);
+            return paths;
+        }
+#endif
+        BlockReader reader(input, ioOptions.blockBytes, runStats.io);
+        generate(reader, inputElements, nullptr);
+        if (std::ferror(input)) {
+            removeRuns();
+            throw std::runtime_error("Reading the external sort input failed.");
+        }
+        return paths;
+    }
+
+    /**
+    * @brief Reads a file of elements and writes it as sorted runs, with O_DIRECT if the options ask for it.
+    * @param inputPath The path of a binary file of elements.
+    * @return The paths of the run files in the order they were written.
+    * @throws std::runtime_error If a file cannot be opened, created, read or written. The run
+    * files written up to then are removed.
+    */
+    std::vector<std::string> generate(const std::string& inputPath) {
+#if defined(SORTS_HAS_POSIX_IO)
+        if (ioOptions.enabled) {
+            bool direct = ioOptions.directIo;
+            int fd = openFile(inputPath, O_RDONLY, direct);
+            if (fd < 0)
+                throw std::runtime_error("Cannot open " + inputPath);
+
+            struct stat status;
+            std::uint64_t inputElements = ::fstat(fd, &status) == 0 ? static_cast<std::uint64_t>(status.st_size) / sizeof(T) : 0;
+            try {
+                AsyncIoService service(ioOptions.threads);
+                BlockReader reader(service, fd, 0, ioOptions, runStats.io);
+                generate(reader, inputElements, &service);
+            }
+            catch (...) {
+                ::close(fd);
+                throw;
+            }
+            ::close(fd);
+            return paths;
+        }
+#endif
+        std::FILE* input = std::fopen(inputPath.c_str(), "rb");
+        if (!input)
+            throw std::runtime_error("Cannot open " + inputPath);
+        std::unique_ptr<std::FILE, int (*)(std::FILE*)> closer(input, &std::fclose);
+        return generate(input);
+    }
+
+    /**
+    * @brief Returns the statistics of the last generate() call.
+    */
+    const ExternalRunStats& stats() const { return runStats; }
+
+private:
+    static const std::size_t stagingBytes = 1 << 16;
+    static const std::size_t sortednessSamples = 4096;
+    static constexpr double nearlySorted = 0.9;
+    static constexpr double mostlyDescending = 0.25;
+
+    // The heap operations put the element no other precedes at the root, so the heap is
+    // ordered by the reversed comparison to keep the smallest element on top.
+    struct Reversed {
+        Compare compare;
+        bool operator()(const T& a, const T& b) const { return compare(b, a); }
+    };
+
+    typedef DaryHeapOps<T, 4, Reversed> Heap;
+
+    // Hands out elements from blocks read either through stdio or ahead of time through an
+    // AsyncFileReader; elements may straddle two blocks.
+    class BlockReader {
+    public:
+        BlockReader(std::FILE* file, std::size_t blockBytes, AsyncIoStats& stats)
+            : file(file), buffer(blockBytes), data(nullptr), available(0), total(0), stats(stats) {}
+
+#if defined(SORTS_HAS_POSIX_IO)
+        BlockReader(AsyncIoService& io, int fd, std::uint64_t offset, const AsyncIoOptions& options, AsyncIoStats& stats)
+            : file(nullptr), async(new AsyncFileReader(io, fd, offset, options.blockBytes, options.depth)), data(nullptr),
+            available(0), total(0), stats(stats) {}
+#endif
+
+        bool next(T& value) {
+            if (available >= sizeof(T)) {
+                std::memcpy(&value, data, sizeof(T));
+                data += sizeof(T);
+                available -= sizeof(T);
+            }
+            else if (readBytes(&value, sizeof(T)) != sizeof(T)) {
+                return false;
+            }
+            total++;
+            return true;
+        }
+
+        std::size_t read(T* out, std::size_t count) {
+            return readBytes(out, count * sizeof(T)) / sizeof(T);
+        }
+
+        std::uint64_t consumed() const { return total; }
+
+    private:
+        std::FILE* file;
+        std::vector<char> buffer;
+#if defined(SORTS_HAS_POSIX_IO)
+        std::unique_ptr<AsyncFileReader> async;
+#endif
+        const char* data;
+        std::size_t available;
+        std::uint64_t total;
+        AsyncIoStats& stats;
+
+        std::size_t readBytes(void* out, std::size_t bytes) {
+            char* target = static_cast<char*>(out);
+            std::size_t copied = 0;
+            while (copied < bytes) {
+                if (available == 0 && !refill())
+                    break;
+
+                std::size_t take = std::min(available, bytes - copied);
+                std::memcpy(target + copied, data, take);
+                data += take;
+                available -= take;
+                copied += take;
+            }
+            return copied;
+        }
+
+        bool refill() {
+#if defined(SORTS_HAS_POSIX_IO)
+            if (async) {
+                available = async->next(data);
+                return available != 0;
+            }
+#endif
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            available = std::fread(buffer.data(), 1, buffer.size(), file);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            stats.requests++;
+            stats.bytesRead += available;
+            stats.ioSeconds += seconds;
+            stats.stallSeconds += seconds;
+            data = buffer.data();
+            return available != 0;
+        }
+    };
+
+    // Collects elements into a staging block and writes it either through stdio or behind the
+    // caller through an AsyncFileWriter.
+    class RunWriter {
+    public:
+        RunWriter(const std::string& path, std::size_t capacity, std::uint64_t& bytesWritten, AsyncIoStats& stats)
+            : file(std::fopen(path.c_str(), "wb")), block(capacity), size(0), bytesWritten(bytesWritten), stats(stats) {
+            if (!file)
+                throw std::runtime_error("Cannot create run file " + path);
+        }
+
+#if defined(SORTS_HAS_POSIX_IO)
+        RunWriter(AsyncIoService& io, const std::string& path, std::size_t capacity, const AsyncIoOptions& options,
+            std::uint64_t& bytesWritten, AsyncIoStats& stats)
+            : file(nullptr), block(capacity), size(0), bytesWritten(bytesWritten), stats(stats) {
+            bool direct = options.directIo;
+            fd = openFile(path, O_WRONLY | O_CREAT | O_TRUNC, direct);
+            if (fd < 0)
+                throw std::runtime_error("Cannot create run file " + path);
+            async.reset(new AsyncFileWriter(io, fd, options.blockBytes, options.depth, direct));
+        }
+#endif
+
+        ~RunWriter() {
+            if (file) {
+                std::fclose(file);
+            }
+#if defined(SORTS_HAS_POSIX_IO)
+            async.reset();
+            if (fd >= 0) {
+                ::close(fd);
+            }
+#endif
+        }
+
+        void push(const T& value) {
+            block[size++] = value;
+            if (size == block.size()) {
+                flush();
+            }
+        }
+
+        void write(const T* values, std::size_t count) {
+            flush();
+            writeAll(values, count);
+        }
+
+        void close() {
+            flush();
+#if defined(SORTS_HAS_POSIX_IO)
+            if (async) {
+                async->finish();
+                async.reset();
+                int closing = fd;
+                fd = -1;
+                if (::close(closing) != 0)
+                    throw std::runtime_error("Writing a run file failed.");
+                return;
+            }
+#endif
+            std::FILE* closing = file;
+            file = nullptr;
+            if (std::fclose(closing) != 0)
+                throw std::runtime_error("Writing a run file failed.");
+        }
+
+    private:
+        std::FILE* file;
+#if defined(SORTS_HAS_POSIX_IO)
+        int fd = -1;
+        std::unique_ptr<AsyncFileWriter> async;
+#endif
+        std::vector<T> block;
+        std::size_t size;
+        std::uint64_t& bytesWritten;
+        AsyncIoStats& stats;
+
+        void flush() {
+            writeAll(block.data(), size);
+            size = 0;
+        }
+
+        void writeAll(const T* values, std::size_t count) {
+            std::size_t bytes = count * sizeof(T);
+            bytesWritten += bytes;
+#if defined(SORTS_HAS_POSIX_IO)
+            if (async) {
+                async->append(values, bytes);
+                return;
+            }
+#endif
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (std::fwrite(values, sizeof(T), count, file) != count)
+                throw std::runtime_error("Writing a run file failed.");
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            stats.requests++;
+            stats.bytesWritten += bytes;
+            stats.ioSeconds += seconds;
+            stats.stallSeconds += seconds;
+        }
+    };
+
+    std::size_t memoryElements;
+    std::string pathPrefix;
+    RunGeneration method;
+    std::size_t fanIn;
+    Compare compare;
+    QuickSort3WayStrategy<T, Compare> sorter;
+    AsyncIoOptions ioOptions;
+    std::vector<T> workspace;
+    std::vector<std::string> paths;
+    ExternalRunStats runStats;
+    AsyncIoService* io = nullptr;
+
+    static std::size_t stagingElements() {
+        return std::max<std::size_t>(stagingBytes / sizeof(T), 1);
+    }
+
+#if defined(SORTS_HAS_POSIX_IO)
+    // Opens with O_DIRECT when asked and the file system allows it; direct tells whether it did.
+    static int openFile(const std::string& path, int flags, bool& direct) {
+#if defined(O_DIRECT)
+        if (direct) {
+            int fd = ::open(path.c_str(), flags | O_DIRECT | O_CLOEXEC, 0644);
+            if (fd >= 0)
+                return fd;
+        }
+#endif
+        direct = false;
+        return ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+    }
+#endif
+
+    void generate(BlockReader& reader, std::uint64_t inputElements, AsyncIoService* service) {
+        runStats = ExternalRunStats();
+        paths.clear();
+        io = service;
+
+        workspace.resize(memoryElements);
+        std::size_t filled = reader.read(workspace.data(), memoryElements);
+        runStats.elementsRead = filled;
+        runStats.sortedness = sortedness(workspace.data(), filled);
+
+        runStats.method = method;
+        if (method == RunGeneration::Auto) {
+            std::uint64_t loadRuns = (inputElements + memoryElements - 1) / memoryElements;
+            bool onePass = inputElements != 0 && loadRuns <= fanIn;
+            bool useReplacement = runStats.sortedness >= nearlySorted || (runStats.sortedness > mostlyDescending && !onePass);
+            runStats.method = useReplacement ? RunGeneration::ReplacementSelection : RunGeneration::LoadSortStore;
+        }
+
+        try {
+            if (filled != 0) {
+                if (runStats.method == RunGeneration::ReplacementSelection) {
+                    replacementSelection(reader, filled);
+                }
+                else {
+                    loadSortStore(reader, filled);
+                }
+            }
+        }
+        catch (...) {
+            // The run writers are closed by now, so the files can go.
+            io = nullptr;
+            removeRuns();
+            throw;
+        }
+        runStats.elementsRead += reader.consumed();
+
+#if defined(SORTS_HAS_POSIX_IO)
+        if (io) {
+            runStats.io = io->stats();
+            io = nullptr;
+        }
+#endif
+        workspace.clear();
+        workspace.shrink_to_fit();
+    }
+
+    // The number of elements left in a seekable input, or 0 when it cannot be told.
+    static std::uint64_t remainingElements(std::FILE* input) {
+        std::int64_t position = tell(input);
+        if (position < 0 || !seek(input, 0, SEEK_END))
+            return 0;
+
+        std::int64_t end = tell(input);
+        seek(input, position, SEEK_SET);
+        return end > position ? static_cast<std::uint64_t>(end - position) / sizeof(T) : 0;
+    }
+
+    // Stream positions in 64 bits; the long of std::ftell has 32 bits on Windows.
+    static std::int64_t tell(std::FILE* file) {
+#if defined(_WIN32)
+        return _ftelli64(file);
+#elif defined(SORTS_HAS_POSIX_IO)
+        return static_cast<std::int64_t>(::ftello(file));
+#else
+        return std::ftell(file);
+#endif
+    }
+
+    static bool seek(std::FILE* file, std::int64_t offset, int origin) {
+#if defined(_WIN32)
+        return _fseeki64(file, offset, origin) == 0;
+#elif defined(SORTS_HAS_POSIX_IO)
+        return ::fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#else
+        return std::fseek(file, static_cast<long>(offset), origin) == 0;
+#endif
+    }
+
+    void removeRuns() {
+        for (const auto& path : paths) {
+            std::remove(path.c_str());
+        }
+        paths.clear();
+    }
+
+    // The fraction of evenly spaced adjacent pairs that are in order.
+    double sortedness(const T* values, std::size_t count) const {
+        if (count < 2)
+            return 1;
+
+        std::size_t pairs = std::min(count - 1, sortednessSamples);
+        std::size_t ordered = 0;
+        for (std::size_t i = 0; i < pairs; i++) {
+            std::size_t at = i * (count - 1) / pairs;
+            ordered += !compare(values[at + 1], values[at]);
+        }
+        return static_cast<double>(ordered) / pairs;
+    }
+
+    // Only paths whose file was created are recorded, so that removeRuns() never deletes
+    // something that was in the way.
+    std::unique_ptr<RunWriter> openRun() {
+        std::string path = pathPrefix + std::to_string(paths.size()) + ".run";
+        std::unique_ptr<RunWriter> run;
+#if defined(SORTS_HAS_POSIX_IO)
+        if (io) {
+            run.reset(new RunWriter(*io, path, stagingElements(), ioOptions, runStats.bytesWritten, runStats.io));
+        }
+#endif
+        if (!run) {
+            run.reset(new RunWriter(path, stagingElements(), runStats.bytesWritten, runStats.io));
+        }
+        paths.push_back(path);
+        runStats.runCount++;
+        return run;
+    }
+
+    void loadSortStore(BlockReader& reader, std::size_t filled) {
+        while (filled != 0) {
+            workspace.resize(filled);
+            sorter.sort(workspace);
+
+            std::unique_ptr<RunWriter> run = openRun();
+            run->write(workspace.data(), filled);
+            run->close();
+
+            workspace.resize(memoryElements);
+            filled = reader.read(workspace.data(), memoryElements);
+            runStats.elementsRead += filled;
+        }
+    }
+
+    // The heap occupies [0, heapSize) of the workspace and the elements parked for the next run
+    // [heapSize, filled). Every parked element shrinks the heap by one, so the current run ends
+    // exactly when the workspace holds only the next one.
+    void replacementSelection(BlockReader& reader, std::size_t filled) {
+        Reversed order = { compare };
+        T* heap = workspace.data();
+        std::size_t heapSize = filled;
+        Heap::makeHeap(heap, heapSize, order);
+        std::unique_ptr<RunWriter> run = openRun();
+
+        T incoming;
+        while (reader.next(incoming)) {
+            T smallest = heap[0];
+            run->push(smallest);
+
+            if (!compare(incoming, smallest)) {
+                Heap::siftHole(heap, heapSize, 0, incoming, order);
+            }
+            else {
+                heapSize--;
+                T moved = heap[heapSize];
+                heap[heapSize] = incoming;
+                if (heapSize != 0) {
+                    Heap::siftHole(heap, heapSize, 0, moved, order);
+                }
+            }
+
+            if (heapSize == 0) {
+                run->close();
+                heapSize = filled;
+                Heap::makeHeap(heap, heapSize, order);
+                run = openRun();
+            }
+        }
+
+        drain(heap, heapSize, order, *run);
+        run->close();
+
+        if (heapSize != filled) {
+            std::size_t parked = filled - heapSize;
+            Heap::makeHeap(heap + heapSize, parked, order);
+            run = openRun();
+            drain(heap + heapSize, parked, order, *run);
+            run->close();
+        }
+    }
+
+    static void drain(T* heap, std::size_t size, Reversed& order, RunWriter& run) {
+        while (size != 0) {
+            run.push(heap[0]);
+            size--;
+            if (size != 0) {
+                T moved = heap[size];
+                Heap::siftHole(heap, size, 0, moved, order);
+            }
+        }
+    }
+};
 
+template <typename T, typename Compare>
+const std::size_t ExternalRunGenerator<T, Compare>::sortednessSamples;
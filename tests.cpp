@@ -3,8 +3,71 @@
 #include <vector>
 #include <algorithm>
 #include <random>
+#include <tuple>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <functional>
+#include <cstdlib>
+#include <new>
+#include <queue>
+#include <unordered_map>
 #include "Sorts.cpp"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define SORTS_TESTS_HAVE_PTHREAD 1
+#endif
+
+static std::atomic<std::size_t> allocationCount(0);
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size) {
+    allocationCount++;
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+// Returns the best wall-clock time of three runs of the body, in seconds; for the skipped benchmarks.
+template <typename Body>
+static double bestOfThree(Body body) {
+    double best = 1e9;
+    for (int round = 0; round < 3; round++) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+static std::vector<std::string> makeUrlLikeStrings(std::mt19937& generator, std::size_t count) {
+    const char* hosts[] = { "https://example.com/", "https://example.org/api/v1/", "http://cdn.example.net/static/" };
+    std::uniform_int_distribution<int> letter('a', 'f');
+    std::uniform_int_distribution<int> length(0, 24);
+
+    std::vector<std::string> strings(count);
+    for (auto& value : strings) {
+        value = hosts[generator() % 3];
+        int size = length(generator);
+        for (int i = 0; i < size; i++) {
+            value.push_back(static_cast<char>(letter(generator)));
+        }
+    }
+    return strings;
+}
+
 TEST_CASE("Sorting Algorithms") {
     std::random_device rd;
     std::mt19937 generator(rd());
@@ -64,6 +127,66 @@ TEST_CASE("Sorting Algorithms") {
         CHECK(std::is_sorted(numbers.begin(), numbers.end()));
 
     }
+    SUBCASE("FastHeapSort") {
+        SortingFacade<int>::getInstance()->setSortStrategy("heapsort-fast");
+
+        std::cout << "FastHeapSort: ";
+        std::vector<int> numbers(100000);
+        std::uniform_int_distribution<int> distribution(-100000, 100000);
+        for (auto& number : numbers) {
+            number = distribution(generator);
+        }
+
+        SortingFacade<int>::getInstance()->sort(numbers);
+
+        CHECK(std::is_sorted(numbers.begin(), numbers.end()));
+
+        // Every size around the aligned root offset, with another order and element size.
+        std::mt19937 sweepGenerator(28);
+        bool sorted = true;
+        for (std::size_t size = 0; size < 200; size++) {
+            std::vector<int> descending(size);
+            std::vector<char> bytes(size);
+            for (std::size_t i = 0; i < size; i++) {
+                descending[i] = distribution(sweepGenerator) % 8;
+                bytes[i] = static_cast<char>(distribution(sweepGenerator));
+            }
+            std::vector<int> expected = descending;
+            std::sort(expected.begin(), expected.end(), std::greater<int>());
+            FastHeapSortStrategy<int, std::greater<int>>().sort(descending);
+            FastHeapSortStrategy<char>().sort(bytes);
+            sorted = sorted && descending == expected && std::is_sorted(bytes.begin(), bytes.end());
+        }
+        CHECK(sorted);
+    }
+
+    SUBCASE("StringSort") {
+        std::mt19937 stringGenerator(31);
+        std::vector<std::string> strings = makeUrlLikeStrings(stringGenerator, 20000);
+        strings.push_back("");
+        strings.push_back(std::string("with\0zero", 9));
+        std::vector<std::string> expected = strings;
+        std::sort(expected.begin(), expected.end());
+
+        SortingFacade<std::string>::getInstance()->setSortStrategy("stringsort");
+        std::cout << "StringSort: ";
+        std::vector<std::string> multikey = strings;
+        SortingFacade<std::string>::getInstance()->sort(multikey);
+        CHECK(multikey == expected);
+
+        SortingFacade<std::string>::getInstance()->setSortStrategy("stringmergesort");
+        std::cout << "StringMergeSort: ";
+        std::vector<std::string> merged = strings;
+        SortingFacade<std::string>::getInstance()->sort(merged);
+        CHECK(merged == expected);
+
+        SortingFacade<std::string>::getInstance()->setSortStrategy("burstsort");
+        std::cout << "BurstSort: ";
+        std::vector<std::string> burst = strings;
+        SortingFacade<std::string>::getInstance()->sort(burst);
+        CHECK(burst == expected);
+    }
+
     SUBCASE("MergeSort") {
         SortingFacade<long>::getInstance()->setSortStrategy("mergesort");
 
@@ -93,4 +216,2278 @@ TEST_CASE("Sorting Algorithms") {
 
         CHECK(std::is_sorted(numbers.begin(), numbers.end()));
     }
-}
\ No newline at end of file
+}
+
+template <typename T>
+static std::size_t allocationsOfSecondSort(const std::string& algorithm, const std::vector<T>& input) {
+    SortingFacade<T>* facade = SortingFacade<T>::getInstance();
+    facade->setTimingSink(nullptr);
+    facade->setSortStrategy(algorithm);
+
+    std::vector<T> warmUp = input;
+    facade->sort(warmUp);
+
+    std::vector<T> numbers = input;
+    std::size_t before = allocationCount;
+    facade->sort(numbers);
+    std::size_t allocations = allocationCount - before;
+
+    CHECK(std::is_sorted(numbers.begin(), numbers.end()));
+    facade->setTimingSink(&std::cout);
+    return allocations;
+}
+
+TEST_CASE("SortingFacade sort does not allocate once warmed up") {
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<int> distribution(-100000, 100000);
+    std::vector<int> numbers(50000);
+    for (auto& value : numbers) value = distribution(generator);
+    std::vector<int> small(numbers.begin(), numbers.begin() + 2000);
+
+    const char* algorithms[] = { "quicksort", "mergesort", "multithreadmergesort", "heapsort", "heapsort-fast",
+        "quicksort3way", "auto", "countingsort" };
+    for (const char* algorithm : algorithms) {
+        CAPTURE(algorithm);
+        CHECK(allocationsOfSecondSort(algorithm, numbers) == 0);
+    }
+    CHECK(allocationsOfSecondSort<int>("bubblesort", small) == 0);
+    CHECK(allocationsOfSecondSort<int>("insertionsort", small) == 0);
+
+    std::vector<std::string> strings = makeUrlLikeStrings(generator, 20000);
+    const char* stringAlgorithms[] = { "stringsort", "stringmergesort", "burstsort" };
+    for (const char* algorithm : stringAlgorithms) {
+        CAPTURE(algorithm);
+        CHECK(allocationsOfSecondSort(algorithm, strings) == 0);
+    }
+
+    std::ostringstream timings;
+    SortingFacade<int>::getInstance()->setTimingSink(&timings);
+    SortingFacade<int>::getInstance()->sort(small);
+    SortingFacade<int>::getInstance()->setTimingSink(&std::cout);
+    CHECK(timings.str().find("Sorting time: ") == 0);
+}
+
+TEST_CASE("SortingFacade with concurrent callers") {
+    SortingFacade<double>* facade = SortingFacade<double>::getInstance();
+    facade->setDefaultSortStrategy("heapsort-fast");
+
+    const char* algorithms[] = { "quicksort", "mergesort", "heapsort", "heapsort-fast", "insertionsort" };
+    std::atomic<int> unsorted(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 64; t++) {
+        threads.push_back(std::thread([&, t]() {
+            facade->setTimingSink(nullptr);
+            if (t % 2 == 0) {
+                facade->setSortStrategy(algorithms[(t / 2) % 5]);
+            }
+
+            std::mt19937 generator(t);
+            std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+            std::vector<double> numbers(1000);
+            for (int round = 0; round < 20; round++) {
+                for (auto& value : numbers) value = distribution(generator);
+                facade->sort(numbers);
+                if (!std::is_sorted(numbers.begin(), numbers.end()))
+                    unsorted++;
+            }
+        }));
+    }
+    for (int round = 0; round < 10; round++) {
+        facade->setDefaultSortStrategy(round % 2 ? "quicksort" : "mergesort");
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    CHECK(unsorted == 0);
+}
+
+// Returns the number of threads of this process, or 0 where it cannot be read.
+static std::size_t processThreadCount() {
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 8, "Threads:") == 0)
+            return static_cast<std::size_t>(std::strtoul(line.c_str() + 8, nullptr, 10));
+    }
+#endif
+    return 0;
+}
+
+TEST_CASE("SortingFacade callers share the helper threads") {
+    SortingFacade<double>* facade = SortingFacade<double>::getInstance();
+    SortWorkerPool::shared();
+    std::size_t before = processThreadCount();
+
+    const int callers = 64;
+    std::atomic<int> unsorted(0);
+    std::atomic<int> arrived(0);
+    std::atomic<std::size_t> peak(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < callers; t++) {
+        threads.push_back(std::thread([&, t]() {
+            facade->setTimingSink(nullptr);
+            facade->setSortStrategy("multithreadmergesort");
+
+            std::mt19937 generator(t);
+            std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+            std::vector<double> numbers(30000);
+            for (auto& value : numbers) value = distribution(generator);
+            facade->sort(numbers);
+            if (!std::is_sorted(numbers.begin(), numbers.end()))
+                unsorted++;
+
+            // Count while every caller still holds its strategy.
+            arrived++;
+            while (arrived < callers) {
+                std::this_thread::yield();
+            }
+            std::size_t count = processThreadCount();
+            std::size_t seen = peak;
+            while (count > seen && !peak.compare_exchange_weak(seen, count)) {
+            }
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    CHECK(unsorted == 0);
+    if (before > 0) {
+        CHECK(peak <= before + callers);
+    }
+}
+
+struct PoolStressRun {
+    std::vector<std::atomic<int>>* counts;
+    std::size_t offset;
+
+    static void task(void* context, std::size_t index) {
+        PoolStressRun* run = static_cast<PoolStressRun*>(context);
+        (*run->counts)[run->offset + index]++;
+    }
+};
+
+TEST_CASE("SortWorkerPool runs every task of back-to-back runs exactly once") {
+    const std::size_t runs = 50000;
+    std::vector<std::size_t> offsets(runs + 1, 0);
+    for (std::size_t r = 0; r < runs; r++) {
+        offsets[r + 1] = offsets[r] + 1 + r % 7;
+    }
+    std::vector<std::atomic<int>> counts(offsets[runs]);
+    for (auto& count : counts) count = 0;
+
+    // Each run gets its own context, so a helper that mixes up runs touches the wrong indices.
+    std::vector<PoolStressRun> contexts(runs);
+    SortWorkerPool pool(3);
+    for (std::size_t r = 0; r < runs; r++) {
+        contexts[r].counts = &counts;
+        contexts[r].offset = offsets[r];
+        pool.run(&PoolStressRun::task, &contexts[r], offsets[r + 1] - offsets[r]);
+        // Helpers that were woken late get the mutex between two runs, even on a single core.
+        if (r % 2 == 0)
+            std::this_thread::yield();
+    }
+
+    std::size_t wrong = 0;
+    for (auto& count : counts) {
+        if (count != 1)
+            wrong++;
+    }
+    CHECK(wrong == 0);
+}
+
+struct DescendingCheck {
+    std::vector<int> input;
+    bool sorted = false;
+
+    template <typename Tag>
+    void operator()(Tag) {
+        StaticSorter<Tag, int, std::greater<int>> sorter;
+        std::vector<int> numbers = input;
+        sorter.sort(numbers);
+        sorted = std::is_sorted(numbers.begin(), numbers.end(), std::greater<int>());
+    }
+};
+
+TEST_CASE("Static dispatch") {
+    std::mt19937 generator(11);
+    std::uniform_int_distribution<int> distribution(-500, 500);
+    std::vector<int> numbers(3000);
+    for (auto& value : numbers) value = distribution(generator);
+
+    SUBCASE("StaticSorter matches the factory strategy") {
+        StaticSorter<QuickSortTag, int> sorter;
+        std::vector<int> expected = numbers;
+        std::unique_ptr<SortStrategy<int>> strategy(SortStrategyFactory<int>::createSortStrategy("quicksort"));
+        strategy->sort(expected);
+
+        sorter.sort(numbers);
+        CHECK(numbers == expected);
+    }
+
+    SUBCASE("Every tagged name sorts with a custom comparator") {
+        const char* algorithms[] = { "quicksort", "mergesort", "bubblesort", "insertionsort",
+            "multithreadmergesort", "heapsort", "heapsort-fast", "quicksort3way", "auto" };
+        for (const char* algorithm : algorithms) {
+            CAPTURE(algorithm);
+            DescendingCheck check;
+            check.input = numbers;
+            CHECK(StaticSortDispatch::visit(algorithm, check));
+            CHECK(check.sorted);
+        }
+
+        DescendingCheck check;
+        CHECK_FALSE(StaticSortDispatch::visit("burstsort", check));
+    }
+
+    SUBCASE("Merge sort with a comparator stays stable") {
+        std::vector<std::pair<int, int>> pairs(2000);
+        for (std::size_t i = 0; i < pairs.size(); i++) {
+            pairs[i] = std::make_pair(distribution(generator) % 10, static_cast<int>(i));
+        }
+        auto byKey = [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first < b.first; };
+        StaticSorter<MergeSortTag, std::pair<int, int>, decltype(byKey)> sorter(byKey);
+
+        sorter.sort(pairs);
+        CHECK(std::is_sorted(pairs.begin(), pairs.end()));
+    }
+}
+
+// Prints M elements/s of the virtual factory strategies against StaticSorter on batches of arrays
+// of one size; with -tc="*benchmark*" --no-skip. Every row sorts 2^22 elements in total.
+TEST_CASE("Static dispatch benchmark" * doctest::skip()) {
+    const std::size_t total = 1 << 22;
+    const char* algorithms[] = { "quicksort", "heapsort-fast" };
+    std::ostringstream header;
+    header << std::left << std::setw(6) << "size" << std::right;
+    for (const char* algorithm : algorithms) {
+        header << std::setw(22) << std::string(algorithm) + " virtual" << std::setw(22) << std::string(algorithm) + " static";
+    }
+    MESSAGE(header.str());
+
+    for (std::size_t size : { 4, 16, 64, 256, 4096, 65536 }) {
+        std::mt19937 generator(38);
+        std::vector<std::vector<int>> input(total / size, std::vector<int>(size));
+        for (auto& array : input) {
+            for (auto& value : array) value = static_cast<int>(generator());
+        }
+
+        std::ostringstream row;
+        row << std::left << std::setw(6) << size << std::right << std::fixed << std::setprecision(1);
+        for (const char* algorithm : algorithms) {
+            std::vector<std::vector<int>> arrays;
+            double virtualSeconds = 1e9;
+            std::unique_ptr<SortStrategy<int>> strategy(SortStrategyFactory<int>::createSortStrategy(algorithm));
+            for (int round = 0; round < 3; round++) {
+                arrays = input;
+                auto start = std::chrono::steady_clock::now();
+                for (auto& array : arrays) strategy->sort(array);
+                virtualSeconds = std::min(virtualSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+            std::vector<std::vector<int>> expected = arrays;
+
+            double staticSeconds = 1e9;
+            StaticSortDispatch::visit(algorithm, [&](auto tag) {
+                StaticSorter<decltype(tag), int> sorter;
+                for (int round = 0; round < 3; round++) {
+                    arrays = input;
+                    auto start = std::chrono::steady_clock::now();
+                    for (auto& array : arrays) sorter.sort(array);
+                    staticSeconds = std::min(staticSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+                }
+            });
+            CHECK(arrays == expected);
+
+            row << std::setw(22) << total / virtualSeconds / 1e6 << std::setw(22) << total / staticSeconds / 1e6;
+        }
+        MESSAGE(row.str());
+    }
+}
+
+template <typename T>
+static void checkMergeKernel(std::mt19937& generator, int leftSize, int rightSize) {
+    std::uniform_int_distribution<int> distribution(-1000, 1000);
+    std::vector<T> left(leftSize);
+    std::vector<T> right(rightSize);
+    for (auto& value : left) value = static_cast<T>(distribution(generator));
+    for (auto& value : right) value = static_cast<T>(distribution(generator));
+    std::sort(left.begin(), left.end());
+    std::sort(right.begin(), right.end());
+
+    std::vector<T> expected(leftSize + rightSize);
+    std::merge(left.begin(), left.end(), right.begin(), right.end(), expected.begin());
+
+    std::vector<T> merged(leftSize + rightSize);
+    MergeKernel<T>::mergeRuns(left.data(), leftSize, right.data(), rightSize, merged.data());
+
+    CHECK(merged == expected);
+}
+
+TEST_CASE("Merge Kernel") {
+    std::mt19937 generator(42);
+    const int sizes[] = { 0, 1, 3, 4, 5, 8, 17, 64, 1000 };
+
+    for (int leftSize : sizes) {
+        for (int rightSize : sizes) {
+            checkMergeKernel<std::int32_t>(generator, leftSize, rightSize);
+            checkMergeKernel<std::uint32_t>(generator, leftSize, rightSize);
+            checkMergeKernel<float>(generator, leftSize, rightSize);
+            checkMergeKernel<double>(generator, leftSize, rightSize);
+            checkMergeKernel<std::int64_t>(generator, leftSize, rightSize);
+            checkMergeKernel<short>(generator, leftSize, rightSize);
+        }
+    }
+}
+
+TEST_CASE("Merge Kernel with non-trivially copyable elements") {
+    std::vector<std::string> left = { "apple", "kiwi", "pear" };
+    std::vector<std::string> right = { "banana", "cherry", "plum", "quince" };
+    std::vector<std::string> merged(left.size() + right.size());
+
+    MergeKernel<std::string>::mergeRuns(left.data(), 3, right.data(), 4, merged.data());
+
+    CHECK(std::is_sorted(merged.begin(), merged.end()));
+}
+
+// Any comparator other than std::less keeps MergeKernel on its scalar merge.
+template <typename T>
+struct ScalarLess {
+    bool operator()(const T& a, const T& b) const { return a < b; }
+};
+
+template <typename T>
+static void benchmarkMergeKernel(const char* name, std::mt19937& generator) {
+    const std::size_t size = 10000000;
+    std::vector<T> left(size);
+    std::vector<T> right(size);
+    for (auto& value : left) value = static_cast<T>(generator() % 1000000000);
+    for (auto& value : right) value = static_cast<T>(generator() % 1000000000);
+    std::sort(left.begin(), left.end());
+    std::sort(right.begin(), right.end());
+
+    std::vector<T> expected(2 * size);
+    std::vector<T> merged(2 * size);
+    double standard = bestOfThree([&]() { std::merge(left.begin(), left.end(), right.begin(), right.end(), expected.begin()); });
+    double scalar = bestOfThree([&]() {
+        MergeKernel<T, ScalarLess<T>>::mergeRuns(left.data(), size, right.data(), size, merged.data());
+    });
+    CHECK(merged == expected);
+    double kernel = bestOfThree([&]() { MergeKernel<T>::mergeRuns(left.data(), size, right.data(), size, merged.data()); });
+    CHECK(merged == expected);
+
+    std::ostringstream row;
+    row << std::left << std::setw(9) << name << std::right << std::setw(6) << (SimdMergeTraits<T>::enabled ? "yes" : "no")
+        << std::fixed << std::setprecision(0) << std::setw(13) << 2 * size / kernel / 1e6
+        << std::setw(13) << 2 * size / scalar / 1e6 << std::setw(13) << 2 * size / standard / 1e6;
+    MESSAGE(row.str());
+}
+
+// Prints M elements/s for merging two sorted 10M arrays; with -tc="*benchmark*" --no-skip, and -mavx2 for 64-bit lanes.
+TEST_CASE("Merge Kernel benchmark" * doctest::skip()) {
+    std::mt19937 generator(26);
+    MESSAGE("type       simd   kernel M/s   scalar M/s   std::merge");
+    benchmarkMergeKernel<std::int32_t>("int32", generator);
+    benchmarkMergeKernel<std::uint32_t>("uint32", generator);
+    benchmarkMergeKernel<float>("float", generator);
+    benchmarkMergeKernel<std::int64_t>("int64", generator);
+    benchmarkMergeKernel<double>("double", generator);
+}
+
+// Prints M elements/s of both heapsorts at 1M, 10M and 100M random ints; with -tc="*benchmark*" --no-skip.
+// The 100M row needs about 1 GB.
+TEST_CASE("Heapsort benchmark" * doctest::skip()) {
+    MESSAGE("elements     heapsort-fast M/s       heapsort M/s std::sort_heap M/s");
+    for (std::size_t size : { 1000000, 10000000, 100000000 }) {
+        std::mt19937 generator(28);
+        std::vector<int> input(size);
+        for (auto& value : input) value = static_cast<int>(generator());
+        std::vector<int> expected = input;
+        std::sort(expected.begin(), expected.end());
+
+        std::ostringstream row;
+        row << std::left << std::setw(11) << size << std::right << std::fixed << std::setprecision(1);
+        for (const char* algorithm : { "heapsort-fast", "heapsort" }) {
+            std::unique_ptr<SortStrategy<int>> strategy(SortStrategyFactory<int>::createSortStrategy(algorithm));
+            std::vector<int> numbers = input;
+            auto start = std::chrono::steady_clock::now();
+            strategy->sort(numbers);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            row << std::setw(19) << size / seconds / 1e6;
+            CHECK(numbers == expected);
+        }
+
+        std::vector<int> numbers = input;
+        auto start = std::chrono::steady_clock::now();
+        std::make_heap(numbers.begin(), numbers.end());
+        std::sort_heap(numbers.begin(), numbers.end());
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        row << std::setw(19) << size / seconds / 1e6;
+        CHECK(numbers == expected);
+        MESSAGE(row.str());
+    }
+}
+
+TEST_CASE("DaryHeap") {
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<int> distribution(-1000, 1000);
+
+    SUBCASE("Push and pop") {
+        DaryHeap<int> heap;
+        std::vector<int> values(5000);
+        for (auto& value : values) {
+            value = distribution(generator);
+            heap.push(value);
+        }
+
+        std::vector<int> popped;
+        while (!heap.empty()) {
+            popped.push_back(heap.top());
+            heap.pop();
+        }
+
+        std::sort(values.begin(), values.end(), std::greater<int>());
+        CHECK(popped == values);
+    }
+
+    SUBCASE("Bulk heapify and update key") {
+        std::vector<double> values(3000);
+        for (auto& value : values) {
+            value = distribution(generator);
+        }
+
+        AddressableDaryHeap<double, 8, std::greater<double>> heap;
+        heap.assign(values.begin(), values.end());
+
+        for (int i = 0; i < 100; i++) {
+            values.push_back(distribution(generator));
+            CHECK(heap.push(values.back()) == values.size() - 1);
+        }
+
+        for (std::size_t handle = 0; handle < values.size(); handle += 3) {
+            values[handle] = distribution(generator) * 2.0;
+            heap.updateKey(handle, values[handle]);
+            CHECK(heap.value(handle) == values[handle]);
+        }
+
+        std::vector<double> popped;
+        while (!heap.empty()) {
+            CHECK(heap.value(heap.topHandle()) == heap.top());
+            popped.push_back(heap.top());
+            heap.pop();
+        }
+
+        std::sort(values.begin(), values.end());
+        CHECK(popped == values);
+    }
+}
+
+// Prints M operations/s of DaryHeap and std::priority_queue from 1e3 to 1e8 elements; with
+// -tc="*benchmark*" --no-skip. Small heaps are filled and drained repeatedly, so every row
+// moves at least 1e7 elements.
+TEST_CASE("DaryHeap benchmark" * doctest::skip()) {
+    MESSAGE("elements    push+pop DaryHeap   push+pop std::pq   heapify DaryHeap   heapify std::pq");
+    for (std::size_t size = 1000; size <= 100000000; size *= 10) {
+        std::mt19937 generator(29);
+        std::vector<int> input(size);
+        for (auto& value : input) value = static_cast<int>(generator());
+        std::size_t rounds = std::max<std::size_t>(1, 10000000 / size);
+        std::uint64_t heapSum = 0;
+        std::uint64_t queueSum = 0;
+
+        auto seconds = [rounds](const std::function<void()>& body) {
+            auto start = std::chrono::steady_clock::now();
+            for (std::size_t round = 0; round < rounds; round++) {
+                body();
+            }
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        double heapPushPop = seconds([&]() {
+            DaryHeap<int> heap;
+            for (int value : input) heap.push(value);
+            while (!heap.empty()) {
+                heapSum = heapSum * 31 + heap.top();
+                heap.pop();
+            }
+        });
+        double queuePushPop = seconds([&]() {
+            std::priority_queue<int> queue;
+            for (int value : input) queue.push(value);
+            while (!queue.empty()) {
+                queueSum = queueSum * 31 + queue.top();
+                queue.pop();
+            }
+        });
+        CHECK(heapSum == queueSum);
+
+        double heapHeapify = seconds([&]() {
+            DaryHeap<int> heap;
+            heap.assign(input.begin(), input.end());
+            heapSum += heap.top();
+        });
+        double queueHeapify = seconds([&]() {
+            std::priority_queue<int> queue(std::less<int>(), input);
+            queueSum += queue.top();
+        });
+        CHECK(heapSum == queueSum);
+
+        double elements = static_cast<double>(size) * rounds / 1e6;
+        std::ostringstream row;
+        row << std::left << std::setw(10) << size << std::right << std::fixed << std::setprecision(1)
+            << std::setw(19) << elements / heapPushPop << std::setw(19) << elements / queuePushPop
+            << std::setw(19) << elements / heapHeapify << std::setw(18) << elements / queueHeapify;
+        MESSAGE(row.str());
+    }
+}
+
+struct TaggedKey {
+    int key;
+    int tag;
+
+    bool operator<(const TaggedKey& other) const { return key < other.key; }
+};
+
+TEST_CASE("KWayMerge") {
+    std::mt19937 generator(11);
+
+    SUBCASE("Many small runs") {
+        std::uniform_int_distribution<int> distribution(0, 1000000);
+        std::vector<std::vector<int>> runs(300);
+        std::vector<int> expected;
+        for (auto& run : runs) {
+            run.resize(generator() % 50);
+            for (auto& value : run) {
+                value = distribution(generator);
+            }
+            std::sort(run.begin(), run.end());
+            expected.insert(expected.end(), run.begin(), run.end());
+        }
+        std::sort(expected.begin(), expected.end());
+
+        CHECK(KWayMerge<int>::merge(runs) == expected);
+    }
+
+    SUBCASE("Parallel merge matches the sequential one") {
+        std::uniform_int_distribution<int> distribution(0, 50);
+        std::vector<std::vector<TaggedKey>> runs(40);
+        std::vector<SortedRun<TaggedKey>> spans;
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < runs.size(); i++) {
+            runs[i].resize(2000 + generator() % 6000);
+            for (std::size_t j = 0; j < runs[i].size(); j++) {
+                runs[i][j].key = distribution(generator);
+                runs[i][j].tag = static_cast<int>(i);
+            }
+            std::sort(runs[i].begin(), runs[i].end());
+            spans.push_back(SortedRun<TaggedKey>(runs[i].data(), runs[i].data() + runs[i].size()));
+            total += runs[i].size();
+        }
+
+        std::vector<TaggedKey> sequential(total);
+        std::vector<TaggedKey> parallel(total);
+        KWayMerge<TaggedKey>::merge(spans, sequential.data());
+        KWayMerge<TaggedKey>::parallelMerge(spans, parallel.data(), 4);
+
+        bool identical = true;
+        for (std::size_t i = 0; i < total; i++) {
+            identical = identical && sequential[i].key == parallel[i].key && sequential[i].tag == parallel[i].tag;
+        }
+        CHECK(identical);
+        CHECK(std::is_sorted(sequential.begin(), sequential.end(), [](const TaggedKey& a, const TaggedKey& b) {
+            return a.key < b.key || (a.key == b.key && a.tag < b.tag);
+        }));
+    }
+
+    SUBCASE("Runs sorted by a custom comparator") {
+        std::uniform_int_distribution<int> distribution(0, 1000);
+        std::vector<std::vector<int>> runs(20);
+        std::vector<int> expected;
+        for (auto& run : runs) {
+            run.resize(5000 + generator() % 5000);
+            for (auto& value : run) {
+                value = distribution(generator);
+            }
+            std::sort(run.begin(), run.end(), std::greater<int>());
+            expected.insert(expected.end(), run.begin(), run.end());
+        }
+        std::sort(expected.begin(), expected.end(), std::greater<int>());
+
+        std::vector<SortedRun<int>> spans;
+        for (const auto& run : runs) {
+            spans.push_back(SortedRun<int>(run.data(), run.data() + run.size()));
+        }
+        std::vector<int> parallel(expected.size());
+        KWayMerge<int, std::greater<int>>::parallelMerge(spans, parallel.data(), 4);
+
+        CHECK(KWayMerge<int, std::greater<int>>::merge(runs) == expected);
+        CHECK(parallel == expected);
+    }
+}
+
+struct CompositeRecord {
+    std::int32_t id;
+    double score;
+    bool hasName;
+    std::string name;
+};
+
+TEST_CASE("NormalizedKeySort") {
+    std::mt19937 generator(5);
+    std::uniform_int_distribution<int> small(-3, 3);
+    const double scores[] = { -1.5, -0.0, 0.0, 2.25, 1e300, -1e-300 };
+    const char* names[] = { "", "a", "ab", "b", "a\0b", "zz" };
+
+    std::vector<CompositeRecord> records(5000);
+    for (auto& record : records) {
+        record.id = small(generator) * 1000000;
+        record.score = scores[generator() % 6];
+        record.hasName = generator() % 5 != 0;
+        std::size_t name = generator() % 6;
+        record.name = std::string(names[name], name == 4 ? 3 : std::strlen(names[name]));
+    }
+
+    // (id desc, score asc, name asc nulls last)
+    NormalizedKeySort<CompositeRecord> sorter;
+    sorter.sort(records, [](const CompositeRecord& record, NormalizedKeyEncoder& encoder) {
+        encoder.addInt32(record.id, SortOrder::Descending).addDouble(record.score);
+        if (record.hasName)
+            encoder.addPresent(NullOrder::NullsLast).addString(record.name);
+        else
+            encoder.addNull(NullOrder::NullsLast);
+    });
+
+    CHECK(records.size() == 5000);
+    CHECK(std::is_sorted(records.begin(), records.end(), [](const CompositeRecord& a, const CompositeRecord& b) {
+        if (a.id != b.id)
+            return a.id > b.id;
+        if (a.score != b.score)
+            return a.score < b.score;
+        if (a.hasName != b.hasName)
+            return a.hasName;
+        return a.hasName && a.name < b.name;
+    }));
+}
+
+TEST_CASE("ColumnarSort") {
+    std::mt19937 generator(9);
+    const std::size_t rows = 20000;
+
+    std::vector<int> region(rows);
+    std::vector<double> revenue(rows);
+    std::vector<std::string> customer(rows);
+    std::vector<long> rowId(rows);
+    for (std::size_t i = 0; i < rows; i++) {
+        region[i] = static_cast<int>(generator() % 7) - 3;
+        revenue[i] = static_cast<double>(generator() % 50) / 4.0;
+        customer[i] = std::string(1, static_cast<char>('a' + generator() % 5));
+        rowId[i] = static_cast<long>(i);
+    }
+
+    std::vector<std::tuple<int, double, std::string, long>> expected;
+    for (std::size_t i = 0; i < rows; i++) {
+        expected.push_back(std::make_tuple(region[i], -revenue[i], customer[i], rowId[i]));
+    }
+    std::sort(expected.begin(), expected.end());
+    std::vector<std::string> originalCustomer = customer;
+
+    // (region asc, revenue desc, customer asc, row id asc)
+    ColumnarSort sorter;
+    sorter.addKeyColumn(region)
+        .addKeyColumn(revenue, SortOrder::Descending)
+        .addKeyColumn(customer)
+        .addPayloadColumn(rowId);
+    sorter.sort(rows, 3);
+
+    bool matches = true;
+    for (std::size_t i = 0; i < rows; i++) {
+        const auto& row = expected[i];
+        matches = matches && region[i] == std::get<0>(row) && revenue[i] == -std::get<1>(row) && customer[i] == std::get<2>(row);
+        matches = matches && originalCustomer[rowId[i]] == customer[i];
+    }
+    CHECK(matches);
+}
+
+struct BenchmarkRow {
+    std::int32_t region;
+    double revenue;
+    std::int64_t id;
+    std::int32_t payload32[3];
+    double payloadDouble[2];
+    std::int64_t payload64[2];
+};
+
+struct BenchmarkColumns {
+    std::vector<std::int32_t> region;
+    std::vector<double> revenue;
+    std::vector<std::int64_t> id;
+    std::vector<std::int32_t> payload32[3];
+    std::vector<double> payloadDouble[2];
+    std::vector<std::int64_t> payload64[2];
+};
+
+// Prints M rows/s for a 10-column table sorted by (region asc, revenue desc, id asc), columnar
+// against sorting row structs; with -tc="*benchmark*" --no-skip. 10M rows need about 3 GB; the
+// 100M-row table of the original request needs ten times that.
+TEST_CASE("ColumnarSort benchmark" * doctest::skip()) {
+    const std::size_t rows = 10000000;
+    std::mt19937 generator(34);
+    BenchmarkColumns input;
+    for (std::size_t i = 0; i < rows; i++) {
+        input.region.push_back(static_cast<std::int32_t>(generator() % 100));
+        input.revenue.push_back(static_cast<double>(generator() % 1000) / 8.0);
+        input.id.push_back(static_cast<std::int64_t>(generator()) << 20 | static_cast<std::int64_t>(i));
+        for (auto& column : input.payload32) column.push_back(static_cast<std::int32_t>(generator()));
+        for (auto& column : input.payloadDouble) column.push_back(generator() / 3.0);
+        for (auto& column : input.payload64) column.push_back(static_cast<std::int64_t>(generator()));
+    }
+
+    auto rowsPerSecond = [rows](std::chrono::steady_clock::time_point start) {
+        return rows / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 1e6;
+    };
+
+    std::vector<std::int64_t> expectedIds;
+    std::vector<std::int64_t> expectedPayload;
+    {
+        BenchmarkColumns output = input;
+        std::vector<BenchmarkRow> table(rows);
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < rows; i++) {
+            BenchmarkRow& row = table[i];
+            row.region = input.region[i];
+            row.revenue = input.revenue[i];
+            row.id = input.id[i];
+            for (int c = 0; c < 3; c++) row.payload32[c] = input.payload32[c][i];
+            for (int c = 0; c < 2; c++) row.payloadDouble[c] = input.payloadDouble[c][i];
+            for (int c = 0; c < 2; c++) row.payload64[c] = input.payload64[c][i];
+        }
+        auto sortStart = std::chrono::steady_clock::now();
+        std::sort(table.begin(), table.end(), [](const BenchmarkRow& a, const BenchmarkRow& b) {
+            if (a.region != b.region) return a.region < b.region;
+            if (a.revenue != b.revenue) return a.revenue > b.revenue;
+            return a.id < b.id;
+        });
+        double sortOnly = rowsPerSecond(sortStart);
+        for (std::size_t i = 0; i < rows; i++) {
+            const BenchmarkRow& row = table[i];
+            output.region[i] = row.region;
+            output.revenue[i] = row.revenue;
+            output.id[i] = row.id;
+            for (int c = 0; c < 3; c++) output.payload32[c][i] = row.payload32[c];
+            for (int c = 0; c < 2; c++) output.payloadDouble[c][i] = row.payloadDouble[c];
+            for (int c = 0; c < 2; c++) output.payload64[c][i] = row.payload64[c];
+        }
+        MESSAGE("row structs, std::sort only: " << sortOnly << " M rows/s");
+        MESSAGE("row structs, with building the rows and writing them back: " << rowsPerSecond(start) << " M rows/s");
+        expectedIds.swap(output.id);
+        expectedPayload.swap(output.payload64[1]);
+    }
+
+    for (unsigned threads : { 1u, 0u }) {
+        BenchmarkColumns columns = input;
+        ColumnarSort sorter;
+        sorter.addKeyColumn(columns.region).addKeyColumn(columns.revenue, SortOrder::Descending).addKeyColumn(columns.id);
+        for (auto& column : columns.payload32) sorter.addPayloadColumn(column);
+        for (auto& column : columns.payloadDouble) sorter.addPayloadColumn(column);
+        for (auto& column : columns.payload64) sorter.addPayloadColumn(column);
+
+        auto start = std::chrono::steady_clock::now();
+        sorter.sort(rows, threads);
+        MESSAGE("ColumnarSort, " << std::string(threads ? "1 thread" : "all threads") << ": " << rowsPerSecond(start) << " M rows/s");
+        CHECK(columns.id == expectedIds);
+        CHECK(columns.payload64[1] == expectedPayload);
+    }
+}
+
+TEST_CASE("ColumnarSort with NaN keys") {
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const double values[] = { 2.5, nan, -1.0, -0.0, nan, 0.0, -std::numeric_limits<double>::infinity(), nan, 7.0 };
+
+    // Few rows are compared directly, many are radix sorted; both must group the NaNs last.
+    for (std::size_t rows : { std::size_t(9), std::size_t(9000) }) {
+        CAPTURE(rows);
+        std::vector<double> key(rows);
+        std::vector<int> second(rows);
+        for (std::size_t i = 0; i < rows; i++) {
+            key[i] = values[i % 9];
+            second[i] = static_cast<int>((rows - i) % 5);
+        }
+
+        ColumnarSort sorter;
+        sorter.addKeyColumn(key).addKeyColumn(second);
+        sorter.sort(rows);
+
+        std::size_t firstNan = rows - (rows / 9) * 3;
+        bool ordered = true;
+        for (std::size_t i = 1; i < rows; i++) {
+            bool bothNan = key[i - 1] != key[i - 1] && key[i] != key[i];
+            bool tied = bothNan || key[i - 1] == key[i];
+            ordered = ordered && (tied ? second[i - 1] <= second[i] : key[i - 1] < key[i] || key[i] != key[i]);
+        }
+        CHECK(ordered);
+        CHECK(key[firstNan - 1] == 7.0);
+        for (std::size_t i = firstNan; i < rows; i++) {
+            REQUIRE(key[i] != key[i]);
+        }
+    }
+}
+
+TEST_CASE("SegmentedSort") {
+    SUBCASE("Sorting networks sort every 0-1 input") {
+        bool sorted = true;
+        for (std::size_t count = 0; count <= 8; count++) {
+            for (unsigned bits = 0; bits < (1u << count); bits++) {
+                int values[8];
+                for (std::size_t i = 0; i < count; i++) {
+                    values[i] = (bits >> i) & 1;
+                }
+                SmallSortKernels<int>::sortingNetwork(values, count);
+                sorted = sorted && std::is_sorted(values, values + count);
+            }
+        }
+        CHECK(sorted);
+    }
+
+    SUBCASE("Segments of mixed sizes") {
+        std::mt19937 generator(13);
+        std::uniform_int_distribution<int> size(0, 500);
+        std::uniform_int_distribution<int> distribution(-50, 50);
+
+        std::vector<std::size_t> offsets(1, 0);
+        std::vector<int> values;
+        for (int segment = 0; segment < 2000; segment++) {
+            int count = segment % 3 == 0 ? size(generator) : size(generator) % 9;
+            for (int i = 0; i < count; i++) {
+                values.push_back(distribution(generator));
+            }
+            offsets.push_back(values.size());
+        }
+
+        std::vector<int> expected = values;
+        for (std::size_t segment = 0; segment + 1 < offsets.size(); segment++) {
+            std::sort(expected.begin() + offsets[segment], expected.begin() + offsets[segment + 1]);
+        }
+
+        SegmentedSortStats stats = SegmentedSort<int>::sort(values, offsets, 4);
+
+        CHECK(stats.segments == 2000);
+        CHECK(values == expected);
+    }
+
+    SUBCASE("Custom comparator") {
+        std::mt19937 generator(35);
+        std::uniform_int_distribution<int> distribution(-1000, 1000);
+
+        std::vector<std::size_t> offsets(1, 0);
+        std::vector<int> values;
+        for (int segment = 0; segment < 300; segment++) {
+            int count = segment % 4 == 0 ? 200 : segment % 20;
+            for (int i = 0; i < count; i++) {
+                values.push_back(distribution(generator));
+            }
+            offsets.push_back(values.size());
+        }
+
+        std::vector<int> expected = values;
+        for (std::size_t segment = 0; segment + 1 < offsets.size(); segment++) {
+            std::sort(expected.begin() + offsets[segment], expected.begin() + offsets[segment + 1], std::greater<int>());
+        }
+
+        SegmentedSort<int, std::greater<int>>::sort(values, offsets, 2);
+
+        CHECK(values == expected);
+    }
+}
+
+// Prints segments/s for 10-500 element segments; with -tc="*benchmark*" --no-skip.
+TEST_CASE("SegmentedSort benchmark" * doctest::skip()) {
+    const std::size_t segments = 200000;
+    std::mt19937 generator(35);
+    std::uniform_int_distribution<int> size(10, 500);
+    std::vector<std::size_t> offsets(1, 0);
+    for (std::size_t segment = 0; segment < segments; segment++) {
+        offsets.push_back(offsets.back() + size(generator));
+    }
+    std::vector<int> input(offsets.back());
+    for (auto& value : input) value = static_cast<int>(generator());
+
+    std::vector<int> expected = input;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t segment = 0; segment < segments; segment++) {
+        std::sort(expected.begin() + offsets[segment], expected.begin() + offsets[segment + 1]);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    MESSAGE("std::sort per segment: " << segments / seconds / 1e6 << " M segments/s");
+
+    std::vector<std::vector<int>> vectors(segments);
+    for (std::size_t segment = 0; segment < segments; segment++) {
+        vectors[segment].assign(input.begin() + offsets[segment], input.begin() + offsets[segment + 1]);
+    }
+    SortingFacade<int>* facade = SortingFacade<int>::getInstance();
+    facade->setTimingSink(nullptr);
+    facade->setSortStrategy("quicksort");
+    start = std::chrono::steady_clock::now();
+    for (auto& vector : vectors) {
+        facade->sort(vector);
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    facade->setTimingSink(&std::cout);
+    MESSAGE("SortingFacade per vector: " << segments / seconds / 1e6 << " M segments/s");
+
+    for (unsigned threads : { 1u, 0u }) {
+        std::vector<int> values = input;
+        SegmentedSortStats stats = SegmentedSort<int>::sort(values, offsets, threads);
+        MESSAGE("SegmentedSort, " << std::string(threads ? "1 thread" : "all threads") << ": "
+            << stats.segmentsPerSecond() / 1e6 << " M segments/s");
+        CHECK(values == expected);
+    }
+}
+
+// Comparing blocks until the test opens the gate, so a SortService worker can be held inside a job.
+struct GatedValue {
+    int value;
+
+    static std::promise<void>* entered;
+    static std::shared_future<void> release;
+
+    bool operator<(const GatedValue& other) const {
+        if (entered) {
+            entered->set_value();
+            entered = nullptr;
+        }
+        release.wait();
+        return value < other.value;
+    }
+};
+
+std::promise<void>* GatedValue::entered = nullptr;
+std::shared_future<void> GatedValue::release;
+
+TEST_CASE("SortService") {
+    SUBCASE("Concurrent producers under saturation") {
+        SortService<int> service(4, 8, 2048);
+        const int producers = 16;
+        const int perProducer = 40;
+        std::vector<std::vector<int>> arrays(producers * perProducer);
+        std::atomic<int> unsorted(0);
+
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; p++) {
+            threads.push_back(std::thread([&, p]() {
+                std::mt19937 generator(p);
+                std::uniform_int_distribution<int> distribution(-1000, 1000);
+                const char* algorithms[] = { "quicksort", "mergesort", "heapsort-fast" };
+                std::vector<std::future<void>> futures;
+                for (int i = 0; i < perProducer; i++) {
+                    std::vector<int>& numbers = arrays[p * perProducer + i];
+                    numbers.resize(i % 4 == 0 ? 20000 : 50 + generator() % 200);
+                    for (auto& value : numbers) value = distribution(generator);
+                    futures.push_back(service.submit(numbers, algorithms[i % 3], i % 3));
+                }
+                for (std::size_t i = 0; i < futures.size(); i++) {
+                    futures[i].get();
+                    const std::vector<int>& numbers = arrays[p * perProducer + i];
+                    if (!std::is_sorted(numbers.begin(), numbers.end()))
+                        unsorted++;
+                }
+            }));
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        SortServiceStats stats = service.stats();
+        CHECK(unsorted == 0);
+        CHECK(stats.submitted == producers * perProducer);
+        CHECK(stats.completed == stats.submitted);
+        CHECK(stats.maxQueueDepth <= 8);
+        CHECK(stats.queueDepth == 0);
+        CHECK(stats.batches <= stats.completed);
+        CHECK(stats.p50LatencySeconds <= stats.p99LatencySeconds);
+    }
+
+    SUBCASE("Backpressure and invalid names") {
+        SortService<GatedValue> service(1, 1);
+        std::promise<void> entered;
+        std::promise<void> release;
+        GatedValue::entered = &entered;
+        GatedValue::release = release.get_future().share();
+        std::vector<GatedValue> gated = { { 2 }, { 1 } };
+        std::vector<GatedValue> small = { { 3 }, { 1 }, { 2 } };
+
+        // Once the worker compares inside the first job, the queue is empty and stays so.
+        std::future<void> first = service.submit(gated, "insertionsort");
+        entered.get_future().wait();
+        std::future<void> second;
+        std::future<void> third;
+        CHECK(service.trySubmit(small, "insertionsort", second));
+        CHECK_FALSE(service.trySubmit(small, "insertionsort", third));
+        CHECK(service.stats().rejected == 1);
+
+        release.set_value();
+        first.get();
+        second.get();
+        CHECK((gated[0].value == 1 && gated[1].value == 2));
+        CHECK((small[0].value == 1 && small[1].value == 2 && small[2].value == 3));
+
+        std::future<void> invalid = service.submit(small, "nosuchsort");
+        CHECK_THROWS_AS(invalid.get(), std::invalid_argument);
+    }
+}
+
+TEST_CASE("IncrementalSort") {
+    std::mt19937 generator(5);
+    std::uniform_int_distribution<int> distribution(0, 5000);
+    std::vector<int> numbers(20000);
+    for (auto& value : numbers) value = distribution(generator);
+    std::vector<int> expected = numbers;
+    std::sort(expected.begin(), expected.end());
+
+    SUBCASE("First k elements") {
+        IncrementalSort<int> lazy(numbers);
+        std::vector<int> prefix;
+        for (int value : lazy) {
+            prefix.push_back(value);
+            if (prefix.size() == 300)
+                break;
+        }
+
+        CHECK(prefix == std::vector<int>(expected.begin(), expected.begin() + 300));
+        CHECK(std::equal(prefix.begin(), prefix.end(), numbers.begin()));
+        CHECK(lazy.position() == 299);
+        CHECK(lazy.next() == expected[299]);
+        CHECK(lazy.next() == expected[300]);
+    }
+
+    SUBCASE("Draining the range sorts the vector") {
+        IncrementalSort<int, std::greater<int>> lazy(numbers);
+        std::size_t count = 0;
+        for (auto it = lazy.begin(); it != lazy.end(); ++it) {
+            count++;
+        }
+
+        CHECK(count == numbers.size());
+        CHECK(lazy.done());
+        CHECK(std::is_sorted(numbers.rbegin(), numbers.rend()));
+    }
+
+    SUBCASE("Empty and sorted input") {
+        std::vector<int> empty;
+        IncrementalSort<int> nothing(empty);
+        CHECK(nothing.begin() == nothing.end());
+
+        IncrementalSort<int> presorted(expected);
+        CHECK(presorted.next() == expected.front());
+    }
+}
+
+// Prints the milliseconds to the first k of 10M random ints, lazily and by sorting everything
+// first; with -tc="*benchmark*" --no-skip.
+TEST_CASE("IncrementalSort benchmark" * doctest::skip()) {
+    const std::size_t size = 10000000;
+    std::mt19937 generator(40);
+    std::vector<int> input(size);
+    for (auto& value : input) value = static_cast<int>(generator());
+    std::vector<int> expected = input;
+    std::sort(expected.begin(), expected.end());
+
+    MESSAGE("k           IncrementalSort ms   quicksort + take ms   std::partial_sort ms");
+    for (std::size_t k : { 10, 1000, 100000, 1000000 }) {
+        std::vector<int> numbers = input;
+        std::vector<int> lazyPrefix;
+        auto start = std::chrono::steady_clock::now();
+        IncrementalSort<int> lazy(numbers);
+        for (std::size_t i = 0; i < k; i++) {
+            lazyPrefix.push_back(lazy.next());
+        }
+        double lazySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        numbers = input;
+        start = std::chrono::steady_clock::now();
+        QuickSortStrategy<int>().sort(numbers);
+        std::vector<int> fullPrefix(numbers.begin(), numbers.begin() + k);
+        double fullSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        numbers = input;
+        start = std::chrono::steady_clock::now();
+        std::partial_sort(numbers.begin(), numbers.begin() + k, numbers.end());
+        double partialSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<int> expectedPrefix(expected.begin(), expected.begin() + k);
+        CHECK(lazyPrefix == expectedPrefix);
+        CHECK(fullPrefix == expectedPrefix);
+        CHECK(std::equal(expectedPrefix.begin(), expectedPrefix.end(), numbers.begin()));
+
+        std::ostringstream row;
+        row << std::left << std::setw(9) << k << std::right << std::fixed << std::setprecision(1)
+            << std::setw(21) << lazySeconds * 1000 << std::setw(22) << fullSeconds * 1000 << std::setw(23) << partialSeconds * 1000;
+        MESSAGE(row.str());
+    }
+}
+
+TEST_CASE("Empty and single-element inputs") {
+    const char* algorithms[] = { "quicksort", "mergesort", "bubblesort", "insertionsort",
+        "multithreadmergesort", "heapsort", "heapsort-fast", "quicksort3way", "auto", "countingsort" };
+    for (const char* algorithm : algorithms) {
+        CAPTURE(algorithm);
+        std::unique_ptr<SortStrategy<int>> strategy(SortStrategyFactory<int>::createSortStrategy(algorithm));
+        std::vector<int> empty;
+        std::vector<int> single = { 42 };
+
+        strategy->sort(empty);
+        strategy->sort(single);
+
+        CHECK(empty.empty());
+        CHECK(single == std::vector<int>({ 42 }));
+    }
+}
+
+// Needs about 12 GB for the values plus the merge buffer of the merge sorts; run it explicitly
+// with --test-case="Sorting more than 2^31 elements" --no-skip on a big-memory machine.
+TEST_CASE("Sorting more than 2^31 elements" * doctest::skip()) {
+    const std::size_t size = 3000000000ull;
+    const char* algorithms[] = { "quicksort", "heapsort-fast", "mergesort", "multithreadmergesort", "heapsort" };
+    std::vector<std::uint32_t> numbers(size);
+
+    for (const char* algorithm : algorithms) {
+        CAPTURE(algorithm);
+        std::mt19937 generator(1);
+        for (auto& value : numbers) value = static_cast<std::uint32_t>(generator());
+
+        std::unique_ptr<SortStrategy<std::uint32_t>> strategy(SortStrategyFactory<std::uint32_t>::createSortStrategy(algorithm));
+        auto start = std::chrono::steady_clock::now();
+        strategy->sort(numbers);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        MESSAGE(algorithm << ": " << size / seconds / 1e6 << " M elements/s");
+
+        CHECK(std::is_sorted(numbers.begin(), numbers.end()));
+    }
+}
+
+// Runs the body on a thread with a 64 KiB stack where threads can be given one.
+template <typename Body>
+static void runOnSmallStack(Body body) {
+#if defined(SORTS_TESTS_HAVE_PTHREAD)
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, 64 * 1024);
+
+    pthread_t thread;
+    int created = pthread_create(&thread, &attributes, [](void* context) -> void* {
+        (*static_cast<Body*>(context))();
+        return nullptr;
+    }, &body);
+    REQUIRE(created == 0);
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attributes);
+#else
+    std::thread(body).join();
+#endif
+}
+
+TEST_CASE("Quicksort and mergesort on a small stack") {
+    bool quicksortSorted = false;
+    bool mergesortSorted = false;
+
+    runOnSmallStack([&]() {
+        // Sorted input makes the last-element pivot pick the largest value every time.
+        std::vector<int> ascending(30000);
+        for (std::size_t i = 0; i < ascending.size(); i++) ascending[i] = static_cast<int>(i);
+        QuickSortStrategy<int> quicksort;
+        quicksort.sort(ascending);
+        quicksortSorted = std::is_sorted(ascending.begin(), ascending.end());
+
+        std::vector<int> descending(1000000);
+        for (std::size_t i = 0; i < descending.size(); i++) descending[i] = static_cast<int>(descending.size() - i);
+        MergeSortStrategy<int> mergesort;
+        mergesort.sort(descending);
+        mergesortSorted = std::is_sorted(descending.begin(), descending.end());
+    });
+
+    CHECK(quicksortSorted);
+    CHECK(mergesortSorted);
+}
+
+// Prints M elements/s of the stack-bounded quicksort and mergesort, run on a 64 KiB stack, against
+// std::sort and std::stable_sort; with -tc="*benchmark*" --no-skip. Sorted input drives the
+// last-element pivot quadratic, so those rows use 30000 elements instead of 10 million.
+TEST_CASE("Stack-bounded sort benchmark" * doctest::skip()) {
+    std::mt19937 generator(42);
+    std::vector<int> random(10000000);
+    for (auto& value : random) value = static_cast<int>(generator());
+    std::vector<int> ascending(30000);
+    for (std::size_t i = 0; i < ascending.size(); i++) ascending[i] = static_cast<int>(i);
+    std::vector<int> descending(ascending.rbegin(), ascending.rend());
+
+    MESSAGE("input        quicksort M/s   std::sort M/s   mergesort M/s   std::stable_sort M/s");
+    for (auto& input : { std::make_pair("random", &random), std::make_pair("ascending", &ascending), std::make_pair("descending", &descending) }) {
+        std::vector<int> expected = *input.second;
+        std::sort(expected.begin(), expected.end());
+
+        auto rate = [&](const std::function<void(std::vector<int>&)>& sort, bool smallStack) {
+            std::vector<int> numbers = *input.second;
+            double seconds = 0;
+            auto body = [&]() {
+                auto start = std::chrono::steady_clock::now();
+                sort(numbers);
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            };
+            if (smallStack)
+                runOnSmallStack(body);
+            else
+                body();
+            CHECK(numbers == expected);
+            return numbers.size() / seconds / 1e6;
+        };
+
+        std::ostringstream row;
+        row << std::left << std::setw(10) << input.first << std::right << std::fixed << std::setprecision(1)
+            << std::setw(16) << rate([](std::vector<int>& numbers) { QuickSortStrategy<int>().sort(numbers); }, true)
+            << std::setw(16) << rate([](std::vector<int>& numbers) { std::sort(numbers.begin(), numbers.end()); }, false)
+            << std::setw(16) << rate([](std::vector<int>& numbers) { MergeSortStrategy<int>().sort(numbers); }, true)
+            << std::setw(23) << rate([](std::vector<int>& numbers) { std::stable_sort(numbers.begin(), numbers.end()); }, false);
+        MESSAGE(row.str());
+    }
+}
+
+TEST_CASE("String sort kernel on nested prefixes") {
+    // Key i is "a" repeated i times and then "b", so every radix pass splits off a single key.
+    const std::size_t count = 20000;
+    std::string buffer(count, 'a');
+    buffer.push_back('b');
+
+    std::vector<StringKey> keys(count);
+    for (std::size_t i = 0; i < count; i++) {
+        StringKey key = { reinterpret_cast<const unsigned char*>(buffer.data()) + count - i, i + 1, i };
+        keys[i] = key;
+    }
+    std::mt19937 generator(31);
+    std::shuffle(keys.begin(), keys.end(), generator);
+
+    bool sorted = true;
+    runOnSmallStack([&]() {
+        StringSortKernel kernel;
+        kernel.sort(keys.data(), keys.size(), 0);
+        for (std::size_t i = 0; i < count; i++) {
+            sorted = sorted && keys[i].index == count - 1 - i;
+        }
+    });
+
+    CHECK(sorted);
+}
+
+TEST_CASE("Burstsort on many identical long strings") {
+    std::mt19937 generator(32);
+    std::string shared(4000, 'x');
+    for (auto& c : shared) c = static_cast<char>('a' + generator() % 26);
+
+    std::vector<std::string> strings;
+    for (int i = 0; i < 6000; i++) {
+        strings.push_back(shared);
+    }
+    for (int i = 0; i < 3000; i++) {
+        std::string variant = shared;
+        variant[generator() % variant.size()] = static_cast<char>('a' + generator() % 26);
+        strings.push_back(variant);
+        strings.push_back(shared.substr(0, generator() % shared.size()));
+    }
+    std::shuffle(strings.begin(), strings.end(), generator);
+
+    std::vector<std::string> expected = strings;
+    std::sort(expected.begin(), expected.end());
+
+    BurstSortStrategy<std::string> burstsort;
+    burstsort.sort(strings);
+    CHECK(strings == expected);
+}
+
+static std::string stringSortHeader(std::initializer_list<const char*> algorithms) {
+    std::ostringstream header;
+    header << std::left << std::setw(14) << "corpus" << std::right;
+    for (const char* algorithm : algorithms) {
+        header << std::setw(22) << std::string(algorithm) + " MB/s";
+    }
+    return header.str();
+}
+
+// Sorts copies of the strings with each algorithm and returns a row of MB/s, counting the string bytes.
+static std::string stringSortRow(const char* corpus, const std::vector<std::string>& strings,
+    std::initializer_list<const char*> algorithms) {
+    std::size_t bytes = 0;
+    for (const auto& value : strings) bytes += value.size();
+    std::vector<std::string> expected = strings;
+    std::sort(expected.begin(), expected.end());
+
+    std::ostringstream row;
+    row << std::left << std::setw(14) << corpus << std::right << std::fixed << std::setprecision(1);
+    for (const char* algorithm : algorithms) {
+        std::unique_ptr<SortStrategy<std::string>> strategy(SortStrategyFactory<std::string>::createSortStrategy(algorithm));
+        std::vector<std::string> sorted;
+        double best = 1e9;
+        for (int round = 0; round < 3; round++) {
+            sorted = strings;
+            auto start = std::chrono::steady_clock::now();
+            strategy->sort(sorted);
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        row << std::setw(22) << bytes / best / 1e6;
+        CHECK(sorted == expected);
+    }
+    return row.str();
+}
+
+// Prints MB/s of the string strategies against the generic ones on 1M strings; with -tc="*benchmark*" --no-skip.
+TEST_CASE("String sort benchmark" * doctest::skip()) {
+    std::mt19937 generator(31);
+    std::vector<std::string> urls = makeUrlLikeStrings(generator, 1000000);
+
+    std::vector<std::string> logKeys(1000000);
+    for (auto& key : logKeys) {
+        std::ostringstream line;
+        line << "2026-10-" << std::setfill('0') << std::setw(2) << 1 + generator() % 28 << "T" << std::setw(2) << generator() % 24
+            << ":" << std::setw(2) << generator() % 60 << " service-" << generator() % 40 << " request " << generator() % 100000;
+        key = line.str();
+    }
+
+    std::vector<std::string> random(1000000);
+    for (auto& value : random) {
+        value.resize(1 + generator() % 12);
+        for (auto& c : value) c = static_cast<char>('a' + generator() % 26);
+    }
+
+    MESSAGE(stringSortHeader({ "stringsort", "stringmergesort", "quicksort", "mergesort" }));
+    for (auto& corpus : { std::make_pair("urls", &urls), std::make_pair("log keys", &logKeys), std::make_pair("random", &random) }) {
+        MESSAGE(stringSortRow(corpus.first, *corpus.second, { "stringsort", "stringmergesort", "quicksort", "mergesort" }));
+    }
+}
+
+// Prints MB/s of burstsort against the multikey strategy on growing sets of short strings; with
+// -tc="*benchmark*" --no-skip. The 100M+ sets burstsort targets need far more memory than a test run.
+TEST_CASE("Burstsort benchmark" * doctest::skip()) {
+    MESSAGE(stringSortHeader({ "burstsort", "stringsort" }));
+    for (std::size_t count : { 1000000, 5000000 }) {
+        std::mt19937 generator(32);
+        std::vector<std::string> shortStrings(count);
+        for (auto& value : shortStrings) {
+            value.resize(4 + generator() % 8);
+            for (auto& c : value) c = static_cast<char>('a' + generator() % 26);
+        }
+        std::vector<std::string> urls = makeUrlLikeStrings(generator, count);
+
+        std::string size = std::to_string(count / 1000000) + "M";
+        MESSAGE(stringSortRow((size + " short").c_str(), shortStrings, { "burstsort", "stringsort" }));
+        MESSAGE(stringSortRow((size + " urls").c_str(), urls, { "burstsort", "stringsort" }));
+    }
+}
+
+TEST_CASE("SortGroupBy") {
+    std::mt19937 generator(9);
+    std::uniform_int_distribution<int> distribution(0, 99);
+
+    SUBCASE("Unique keys with counts") {
+        std::vector<int> numbers(5000);
+        for (auto& value : numbers) value = distribution(generator);
+        std::vector<int> expected = numbers;
+        std::sort(expected.begin(), expected.end());
+
+        SortGroupBy<int> groupBy;
+        std::vector<std::size_t> counts;
+        std::size_t unique = groupBy.sortUnique(numbers, &counts);
+
+        CHECK(unique == numbers.size());
+        CHECK(counts.size() == unique);
+        for (std::size_t i = 0; i < unique; i++) {
+            auto range = std::equal_range(expected.begin(), expected.end(), numbers[i]);
+            CHECK(static_cast<std::size_t>(range.second - range.first) == counts[i]);
+        }
+        expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+        CHECK(numbers == expected);
+    }
+
+    SUBCASE("Aggregated payloads in original order") {
+        struct Sale {
+            int region;
+            int amount;
+            int first;
+        };
+        auto byRegion = [](const Sale& a, const Sale& b) { return a.region < b.region; };
+
+        std::vector<Sale> sales(3000);
+        std::vector<int> totals(10, 0);
+        std::vector<int> firsts(10, -1);
+        for (int i = 0; i < 3000; i++) {
+            sales[i] = { distribution(generator) % 10, distribution(generator), i };
+            totals[sales[i].region] += sales[i].amount;
+            if (firsts[sales[i].region] < 0)
+                firsts[sales[i].region] = i;
+        }
+
+        SortGroupBy<Sale, decltype(byRegion)> groupBy(byRegion);
+        std::size_t groups = groupBy.sortGroupBy(sales, [](Sale& group, const Sale& sale) {
+            group.amount += sale.amount;
+        });
+
+        REQUIRE(groups == 10);
+        for (const Sale& sale : sales) {
+            CHECK(sale.amount == totals[sale.region]);
+            CHECK(sale.first == firsts[sale.region]);
+        }
+    }
+
+    SUBCASE("Empty input") {
+        std::vector<int> empty;
+        std::vector<std::size_t> counts(3);
+        CHECK(SortGroupBy<int>().sortUnique(empty, &counts) == 0);
+        CHECK(counts.empty());
+    }
+}
+
+// Prints the milliseconds to dedupe 10M ints with few distinct keys, fused into the sort and as
+// a pass after it; with -tc="*benchmark*" --no-skip.
+TEST_CASE("SortGroupBy benchmark" * doctest::skip()) {
+    const std::size_t size = 10000000;
+    std::mt19937 generator(43);
+
+    MESSAGE("distinct   sortUnique ms   + counts ms   mergesort + std::unique ms   std::sort + std::unique ms");
+    for (int distinct : { 4, 1000, 100000 }) {
+        std::uniform_int_distribution<int> distribution(0, distinct - 1);
+        std::vector<int> input(size);
+        for (auto& value : input) value = distribution(generator);
+        std::vector<int> expected = input;
+        std::sort(expected.begin(), expected.end());
+        expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+
+        auto milliseconds = [&](const std::function<void(std::vector<int>&)>& dedupe) {
+            std::vector<int> numbers = input;
+            auto start = std::chrono::steady_clock::now();
+            dedupe(numbers);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            CHECK(numbers == expected);
+            return seconds * 1000;
+        };
+
+        SortGroupBy<int> groupBy;
+        std::vector<std::size_t> counts;
+        std::ostringstream row;
+        row << std::left << std::setw(8) << distinct << std::right << std::fixed << std::setprecision(1)
+            << std::setw(16) << milliseconds([&](std::vector<int>& numbers) { groupBy.sortUnique(numbers); })
+            << std::setw(14) << milliseconds([&](std::vector<int>& numbers) { groupBy.sortUnique(numbers, &counts); })
+            << std::setw(29) << milliseconds([](std::vector<int>& numbers) {
+                   MergeSortStrategy<int>().sort(numbers);
+                   numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+               })
+            << std::setw(29) << milliseconds([](std::vector<int>& numbers) {
+                   std::sort(numbers.begin(), numbers.end());
+                   numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+               });
+        MESSAGE(row.str());
+    }
+}
+
+TEST_CASE("Duplicate-heavy inputs") {
+    std::mt19937 generator(13);
+
+    SUBCASE("Three-way QuickSort on every shape") {
+        QuickSort3WayStrategy<int> strategy;
+        const std::size_t sizes[] = { 0, 1, 2, 3, 15, 16, 17, 100, 1000, 100000 };
+        const int ranges[] = { 1, 2, 10, 1000000 };
+        for (std::size_t size : sizes) {
+            for (int range : ranges) {
+                CAPTURE(size);
+                CAPTURE(range);
+                std::uniform_int_distribution<int> distribution(0, range - 1);
+                std::vector<int> numbers(size);
+                for (auto& value : numbers) value = distribution(generator);
+                std::vector<int> expected = numbers;
+                std::sort(expected.begin(), expected.end());
+
+                strategy.sort(numbers);
+                CHECK(numbers == expected);
+
+                std::reverse(numbers.begin(), numbers.end());
+                strategy.sort(numbers);
+                CHECK(numbers == expected);
+            }
+        }
+    }
+
+    SUBCASE("Auto strategy samples the duplicate ratio") {
+        AutoSortStrategy<int> strategy;
+        std::vector<int> statusCodes(200000);
+        std::vector<int> distinct(200000);
+        const int codes[] = { 200, 301, 404, 500 };
+        for (std::size_t i = 0; i < statusCodes.size(); i++) {
+            statusCodes[i] = codes[generator() % 4];
+            distinct[i] = static_cast<int>(generator());
+        }
+
+        CHECK(strategy.duplicateRatio(statusCodes) > 0.9);
+        CHECK(strategy.duplicateRatio(distinct) < 0.125);
+
+        strategy.sort(statusCodes);
+        strategy.sort(distinct);
+        CHECK(std::is_sorted(statusCodes.begin(), statusCodes.end()));
+        CHECK(std::is_sorted(distinct.begin(), distinct.end()));
+    }
+}
+
+// Prints M elements/s of three-way quicksort, the auto strategy, plain quicksort and std::sort on
+// random, few-unique and all-equal ints; with -tc="*benchmark*" --no-skip. Plain quicksort goes
+// quadratic on equal keys, so it only runs on the 30000-element inputs.
+TEST_CASE("Duplicate-heavy benchmark" * doctest::skip()) {
+    std::mt19937 generator(44);
+
+    MESSAGE("input              size   quicksort3way M/s   auto M/s   quicksort M/s   std::sort M/s");
+    for (std::size_t size : { 30000, 10000000 }) {
+        for (int range : { 1000000000, 4, 1 }) {
+            std::uniform_int_distribution<int> distribution(0, range - 1);
+            std::vector<int> input(size);
+            for (auto& value : input) value = distribution(generator);
+            std::vector<int> expected = input;
+            std::sort(expected.begin(), expected.end());
+
+            auto rate = [&](const std::function<void(std::vector<int>&)>& sort) {
+                std::vector<int> numbers = input;
+                auto start = std::chrono::steady_clock::now();
+                sort(numbers);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                CHECK(numbers == expected);
+                return size / seconds / 1e6;
+            };
+
+            std::ostringstream row;
+            row << std::left << std::setw(11) << (range == 1 ? "all equal" : range == 4 ? "4 values" : "random")
+                << std::right << std::setw(12) << size << std::fixed << std::setprecision(1)
+                << std::setw(20) << rate([](std::vector<int>& numbers) { QuickSort3WayStrategy<int>().sort(numbers); })
+                << std::setw(11) << rate([](std::vector<int>& numbers) { AutoSortStrategy<int>().sort(numbers); });
+            if (size <= 30000)
+                row << std::setw(16) << rate([](std::vector<int>& numbers) { QuickSortStrategy<int>().sort(numbers); });
+            else
+                row << std::setw(16) << "-";
+            row << std::setw(16) << rate([](std::vector<int>& numbers) { std::sort(numbers.begin(), numbers.end()); });
+            MESSAGE(row.str());
+        }
+    }
+}
+
+template <typename T>
+static void checkCountingSort(std::mt19937& generator, std::size_t size) {
+    std::uniform_int_distribution<int> distribution(std::numeric_limits<T>::min(), std::numeric_limits<T>::max());
+    std::vector<T> numbers(size);
+    for (auto& value : numbers) value = static_cast<T>(distribution(generator));
+    std::vector<T> expected = numbers;
+    std::sort(expected.begin(), expected.end());
+    std::vector<T> automatic = numbers;
+
+    CountingSortStrategy<T> strategy;
+    strategy.sort(numbers);
+    CHECK(numbers == expected);
+
+    AutoSortStrategy<T> autoStrategy;
+    autoStrategy.sort(automatic);
+    CHECK(automatic == expected);
+}
+
+TEST_CASE("CountingSort") {
+    std::mt19937 generator(17);
+
+    SUBCASE("One and two byte types") {
+        const std::size_t sizes[] = { 0, 1, 100, 70000, 600000 };
+        for (std::size_t size : sizes) {
+            CAPTURE(size);
+            checkCountingSort<char>(generator, size);
+            checkCountingSort<std::int8_t>(generator, size);
+            checkCountingSort<std::uint8_t>(generator, size);
+            checkCountingSort<std::int16_t>(generator, size);
+            checkCountingSort<std::uint16_t>(generator, size);
+        }
+    }
+
+    SUBCASE("Caller-provided and derived ranges") {
+        std::uniform_int_distribution<int> distribution(-500, 1500);
+        std::vector<int> numbers(400000);
+        for (auto& value : numbers) value = distribution(generator);
+        std::vector<int> expected = numbers;
+        std::sort(expected.begin(), expected.end());
+        std::vector<int> derived = numbers;
+
+        CountingSortStrategy<int> ranged(-500, 1500);
+        ranged.sort(numbers);
+        CHECK(numbers == expected);
+
+        CountingSortStrategy<int> unranged;
+        derived.push_back(std::numeric_limits<int>::max());
+        unranged.sort(derived);
+        CHECK(std::is_sorted(derived.begin(), derived.end()));
+        derived.pop_back();
+        CHECK(derived == expected);
+    }
+
+    SUBCASE("Values outside the given range") {
+        std::vector<int> numbers = { 5, 3, 11, 4 };
+        CountingSortStrategy<int> ranged(0, 10);
+        CHECK_THROWS_AS(ranged.sort(numbers), std::out_of_range);
+        CHECK(numbers == std::vector<int>({ 5, 3, 11, 4 }));
+    }
+
+    SUBCASE("Reversed ranges are rejected") {
+        CHECK_THROWS_AS(CountingSortStrategy<int>(10, 0), std::invalid_argument);
+        CHECK_NOTHROW(CountingSortStrategy<int>(7, 7));
+    }
+}
+
+static std::vector<std::pair<std::size_t, std::size_t>> nestedLoopJoin(const std::vector<int>& left, const std::vector<int>& right, JoinType type) {
+    std::vector<std::tuple<int, std::size_t, std::size_t>> matches;
+    for (std::size_t i = 0; i < left.size(); i++) {
+        bool matched = false;
+        for (std::size_t j = 0; j < right.size(); j++) {
+            if (left[i] == right[j]) {
+                matched = true;
+                if (type == JoinType::Inner || type == JoinType::Left)
+                    matches.push_back(std::make_tuple(left[i], i, j));
+            }
+        }
+        if ((!matched && (type == JoinType::Left || type == JoinType::Anti)) || (matched && type == JoinType::Semi))
+            matches.push_back(std::make_tuple(left[i], i, SortMergeJoin<int>::noMatch));
+    }
+    std::sort(matches.begin(), matches.end());
+
+    std::vector<std::pair<std::size_t, std::size_t>> result;
+    for (const auto& match : matches) {
+        result.push_back(std::make_pair(std::get<1>(match), std::get<2>(match)));
+    }
+    return result;
+}
+
+TEST_CASE("SortMergeJoin") {
+    std::mt19937 generator(19);
+    const JoinType types[] = { JoinType::Inner, JoinType::Left, JoinType::Semi, JoinType::Anti };
+
+    SUBCASE("Matches a nested loop join") {
+        std::uniform_int_distribution<int> distribution(0, 60);
+        std::vector<int> left(400);
+        std::vector<int> right(300);
+        for (auto& key : left) key = distribution(generator);
+        for (auto& key : right) key = distribution(generator) + 20;
+
+        SortMergeJoin<int> join("quicksort3way");
+        for (JoinType type : types) {
+            CAPTURE(static_cast<int>(type));
+            CHECK(join.join(left, right, type) == nestedLoopJoin(left, right, type));
+        }
+    }
+
+    SUBCASE("Pre-sorted inputs skip the sort") {
+        std::vector<int> left = { 1, 2, 2, 5, 9 };
+        std::vector<int> right = { 2, 2, 3, 9, 9 };
+        std::vector<std::pair<std::size_t, std::size_t>> matches;
+
+        SortMergeJoin<int> join;
+        join.forEachMatch(left, right, JoinType::Inner, [&matches](std::size_t leftRow, std::size_t rightRow) {
+            matches.push_back(std::make_pair(leftRow, rightRow));
+        }, true, true);
+
+        CHECK(matches == nestedLoopJoin(left, right, JoinType::Inner));
+    }
+
+    SUBCASE("Partitioned join equals the sequential one") {
+        std::uniform_int_distribution<int> distribution(0, 100000);
+        std::vector<int> left(150000);
+        std::vector<int> right(120000);
+        for (auto& key : left) key = distribution(generator);
+        for (auto& key : right) key = distribution(generator);
+        for (std::size_t i = 0; i < 5000; i++) right[i] = 777;
+
+        SortMergeJoin<int> sequential("mergesort", 1);
+        SortMergeJoin<int> parallel("mergesort", 4);
+        for (JoinType type : types) {
+            CAPTURE(static_cast<int>(type));
+            CHECK(parallel.join(left, right, type) == sequential.join(left, right, type));
+        }
+
+        // The partitions run on the shared pool, which the multithreaded strategy uses as well.
+        SortMergeJoin<int> nested("multithreadmergesort", 4);
+        CHECK(nested.join(left, right, JoinType::Inner) == sequential.join(left, right, JoinType::Inner));
+    }
+
+    SUBCASE("Unknown strategies are reported") {
+        SortMergeJoin<int> join("burstsort");
+        std::vector<int> keys = { 1 };
+        CHECK_THROWS_AS(join.join(keys, keys, JoinType::Inner), std::invalid_argument);
+
+        SortMergeJoin<int> partitioned("burstsort", 4);
+        std::vector<int> many(200000);
+        for (std::size_t i = 0; i < many.size(); i++) many[i] = static_cast<int>(i % 1000);
+        CHECK_THROWS_AS(partitioned.join(many, many, JoinType::Semi), std::invalid_argument);
+    }
+}
+
+// Prints the milliseconds of an inner join of 4M left keys with 1M right keys, sort-merge and as an
+// std::unordered_map hash join; with -tc="*benchmark*" --no-skip.
+TEST_CASE("SortMergeJoin benchmark" * doctest::skip()) {
+    typedef SortMergeJoin<int>::Match Match;
+    std::mt19937 generator(46);
+    std::uniform_int_distribution<int> distribution(0, 999999);
+    std::vector<int> left(4000000);
+    std::vector<int> right(1000000);
+    for (auto& key : left) key = distribution(generator);
+    for (auto& key : right) key = distribution(generator);
+    std::vector<int> sortedLeft = left;
+    std::vector<int> sortedRight = right;
+    std::sort(sortedLeft.begin(), sortedLeft.end());
+    std::sort(sortedRight.begin(), sortedRight.end());
+
+    std::vector<Match> expected;
+    auto start = std::chrono::steady_clock::now();
+    std::unordered_map<int, std::vector<std::size_t>> rowsByKey;
+    for (std::size_t row = 0; row < right.size(); row++) {
+        rowsByKey[right[row]].push_back(row);
+    }
+    for (std::size_t row = 0; row < left.size(); row++) {
+        auto found = rowsByKey.find(left[row]);
+        if (found == rowsByKey.end())
+            continue;
+        for (std::size_t rightRow : found->second) {
+            expected.push_back(Match(row, rightRow));
+        }
+    }
+    double hashSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::sort(expected.begin(), expected.end());
+
+    auto milliseconds = [&](unsigned partitions) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Match> matches = SortMergeJoin<int>("mergesort", partitions).join(left, right, JoinType::Inner);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::sort(matches.begin(), matches.end());
+        CHECK(matches == expected);
+        return seconds * 1000;
+    };
+
+    // Rows of the pre-sorted join index the sorted copies, so only the match count is comparable.
+    std::vector<Match> sortedMatches;
+    start = std::chrono::steady_clock::now();
+    SortMergeJoin<int>().forEachMatch(sortedLeft, sortedRight, JoinType::Inner, [&sortedMatches](std::size_t leftRow, std::size_t rightRow) {
+        sortedMatches.push_back(Match(leftRow, rightRow));
+    }, true, true);
+    double sortedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CHECK(sortedMatches.size() == expected.size());
+
+    MESSAGE("join                              ms");
+    auto report = [](const char* name, double milliseconds) {
+        std::ostringstream row;
+        row << std::left << std::setw(26) << name << std::right << std::fixed << std::setprecision(1) << std::setw(10) << milliseconds;
+        MESSAGE(row.str());
+    };
+    report("sort-merge, 1 partition", milliseconds(1));
+    report("sort-merge, 4 partitions", milliseconds(4));
+    report("sort-merge, pre-sorted", sortedSeconds * 1000);
+    report("std::unordered_map hash", hashSeconds * 1000);
+}
+
+template <typename T>
+static std::vector<T> randomSortedSet(std::mt19937& generator, std::size_t count, std::uint32_t range) {
+    std::uniform_int_distribution<std::uint32_t> distribution(0, range);
+    std::vector<T> values(count);
+    for (auto& value : values) value = static_cast<T>(distribution(generator));
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return values;
+}
+
+template <typename T, typename Compare = std::less<T>>
+static void checkSetOps(SortedSetOps<T, Compare>& ops, const std::vector<T>& first, const std::vector<T>& second, Compare compare = Compare()) {
+    std::vector<T> expectedUnion;
+    std::vector<T> expectedIntersection;
+    std::vector<T> expectedDifference;
+    std::set_union(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(expectedUnion), compare);
+    std::set_intersection(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(expectedIntersection), compare);
+    std::set_difference(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(expectedDifference), compare);
+
+    for (SetKernel kernel : { SetKernel::Auto, SetKernel::Merge, SetKernel::Gallop, SetKernel::Simd }) {
+        CAPTURE(static_cast<int>(kernel));
+        CHECK(ops.setUnion(first, second, kernel) == expectedUnion);
+        CHECK(ops.setIntersection(first, second, kernel) == expectedIntersection);
+        CHECK(ops.setDifference(first, second, kernel) == expectedDifference);
+    }
+}
+
+TEST_CASE("SortedSetOps") {
+    std::mt19937 generator(23);
+
+    SUBCASE("Matches the standard algorithms across size ratios") {
+        SortedSetOps<std::int32_t> ops;
+        for (std::size_t smallSize : { 0, 1, 7, 100, 3000 }) {
+            CAPTURE(smallSize);
+            std::vector<std::int32_t> small = randomSortedSet<std::int32_t>(generator, smallSize, 20000);
+            std::vector<std::int32_t> large = randomSortedSet<std::int32_t>(generator, 5000, 20000);
+            checkSetOps(ops, small, large);
+            checkSetOps(ops, large, small);
+        }
+    }
+
+    SUBCASE("Identical, disjoint and interleaved sets") {
+        SortedSetOps<std::uint32_t> ops;
+        std::vector<std::uint32_t> values = randomSortedSet<std::uint32_t>(generator, 1000, 100000);
+        std::vector<std::uint32_t> evens;
+        std::vector<std::uint32_t> odds;
+        for (std::uint32_t i = 0; i < 1000; i++) (i % 2 ? odds : evens).push_back(i);
+        std::vector<std::uint32_t> high = { 4000000000u, 4000000001u, 4000000005u, 4100000000u, 4200000000u };
+
+        checkSetOps(ops, values, values);
+        checkSetOps(ops, evens, odds);
+        checkSetOps(ops, high, values);
+    }
+
+    SUBCASE("Other types and orderings") {
+        SortedSetOps<std::uint64_t> wide;
+        checkSetOps(wide, randomSortedSet<std::uint64_t>(generator, 500, 2000), randomSortedSet<std::uint64_t>(generator, 40, 2000));
+
+        std::vector<std::string> first = { "apple", "kiwi", "mango", "pear" };
+        std::vector<std::string> second = { "banana", "kiwi", "pear", "plum" };
+        SortedSetOps<std::string> strings;
+        checkSetOps(strings, first, second);
+
+        std::vector<std::int32_t> descendingFirst = randomSortedSet<std::int32_t>(generator, 2000, 5000);
+        std::vector<std::int32_t> descendingSecond = randomSortedSet<std::int32_t>(generator, 300, 5000);
+        std::reverse(descendingFirst.begin(), descendingFirst.end());
+        std::reverse(descendingSecond.begin(), descendingSecond.end());
+        SortedSetOps<std::int32_t, std::greater<std::int32_t>> descending;
+        checkSetOps(descending, descendingFirst, descendingSecond);
+    }
+
+    SUBCASE("Parallel slices equal the sequential result") {
+        std::vector<std::int32_t> large = randomSortedSet<std::int32_t>(generator, 400000, 1000000);
+        std::vector<std::int32_t> medium = randomSortedSet<std::int32_t>(generator, 200000, 1000000);
+        std::vector<std::int32_t> small = randomSortedSet<std::int32_t>(generator, 500, 1000000);
+
+        SortedSetOps<std::int32_t> parallel(4);
+        checkSetOps(parallel, large, medium);
+        checkSetOps(parallel, small, large);
+        checkSetOps(parallel, large, small);
+    }
+
+    SUBCASE("SIMD blocks near the end of the output") {
+        SortedSetOps<int> ops;
+        CHECK(ops.setIntersection({ 1, 2, 5, 6, 100, 101, 102, 103 }, { 1, 2, 5, 100 }) == std::vector<int>({ 1, 2, 5, 100 }));
+        CHECK(ops.setIntersection({ 1, 2, 5, 100 }, { 1, 2, 5, 6, 100, 101, 102, 103 }, SetKernel::Simd) == std::vector<int>({ 1, 2, 5, 100 }));
+    }
+
+    SUBCASE("The kernel follows the size ratio") {
+        CHECK(SortedSetOps<std::uint64_t>::chooseKernel(SetOperation::Intersection, 1000, 1000) == SetKernel::Merge);
+        CHECK(SortedSetOps<std::int32_t>::chooseKernel(SetOperation::Union, 1000, 1000) == SetKernel::Merge);
+        CHECK(SortedSetOps<std::int32_t>::chooseKernel(SetOperation::Difference, 1000, 100000000) == SetKernel::Gallop);
+        CHECK(SortedSetOps<std::int32_t>::chooseKernel(SetOperation::Intersection, 100000000, 1000) == SetKernel::Gallop);
+    }
+}
+
+// Prints intersection timings per kernel; with -ts or --no-skip. The ratio is small side : large side.
+TEST_CASE("SortedSetOps benchmark across size ratios" * doctest::skip()) {
+    const std::size_t largeSize = 10000000;
+    const std::uint32_t range = 4 * static_cast<std::uint32_t>(largeSize);
+    std::mt19937 generator(47);
+    std::vector<int> large = randomSortedSet<int>(generator, largeSize, range);
+    SortedSetOps<int> ops;
+
+    auto milliseconds = [](const std::function<std::size_t()>& body, std::size_t& size) {
+        double best = 1e9;
+        for (int round = 0; round < 3; round++) {
+            auto start = std::chrono::steady_clock::now();
+            size = body();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best * 1000;
+    };
+
+    MESSAGE("ratio      merge ms   simd ms  gallop ms    auto ms     std ms");
+    for (std::size_t ratio : { 1, 10, 100, 1000, 10000, 100000 }) {
+        std::vector<int> small = randomSortedSet<int>(generator, largeSize / ratio, range);
+        std::size_t expected = 0;
+        double standard = milliseconds([&]() {
+            std::vector<int> out;
+            std::set_intersection(small.begin(), small.end(), large.begin(), large.end(), std::back_inserter(out));
+            return out.size();
+        }, expected);
+
+        std::ostringstream row;
+        row << "1:" << std::left << std::setw(8) << ratio << std::right << std::fixed << std::setprecision(2);
+        for (SetKernel kernel : { SetKernel::Merge, SetKernel::Simd, SetKernel::Gallop, SetKernel::Auto }) {
+            std::size_t size = 0;
+            row << std::setw(11) << milliseconds([&]() { return ops.setIntersection(small, large, kernel).size(); }, size);
+            CHECK(size == expected);
+        }
+        row << std::setw(11) << standard;
+        MESSAGE(row.str());
+    }
+}
+
+TEST_CASE("LeveledSortedArray") {
+    std::mt19937 generator(29);
+    std::uniform_int_distribution<int> distribution(0, 5000);
+
+    SUBCASE("Views match a fully sorted copy after every batch") {
+        LeveledSortedArray<int> array;
+        std::vector<int> all;
+        for (int batch = 0; batch < 60; batch++) {
+            std::size_t batchSize = batch % 7 == 0 ? 900 : 37;
+            for (std::size_t i = 0; i < batchSize; i++) {
+                int value = distribution(generator);
+                array.insert(value);
+                all.push_back(value);
+            }
+
+            LeveledSortedArray<int>::View view = array.view();
+            std::vector<int> expected = all;
+            std::sort(expected.begin(), expected.end());
+            REQUIRE(view.toVector(1) == expected);
+            CHECK(view.size() == expected.size());
+        }
+
+        CHECK(array.runCount() <= 8);
+
+        LeveledSortedArray<int>::View view = array.view();
+        std::vector<int> expected = all;
+        std::sort(expected.begin(), expected.end());
+        std::vector<int> visited;
+        view.forEach([&visited](int value) { visited.push_back(value); });
+        CHECK(visited == expected);
+
+        for (int probe : { -1, 0, 17, 2500, 4999, 5000, 6000 }) {
+            CAPTURE(probe);
+            auto range = std::equal_range(expected.begin(), expected.end(), probe);
+            CHECK(view.rank(probe) == static_cast<std::size_t>(range.first - expected.begin()));
+            CHECK(view.count(probe) == static_cast<std::size_t>(range.second - range.first));
+            CHECK(view.contains(probe) == (range.first != range.second));
+        }
+        for (std::size_t position = 0; position < expected.size(); position += 97) {
+            CHECK(view.at(position) == expected[position]);
+        }
+        CHECK(view.at(expected.size() - 1) == expected.back());
+    }
+
+    SUBCASE("Snapshots do not see later changes") {
+        LeveledSortedArray<int> array("quicksort");
+        std::vector<int> first = { 5, 3, 9, 1 };
+        array.insert(first.begin(), first.end());
+        LeveledSortedArray<int>::View before = array.view();
+
+        for (int i = 0; i < 200; i++) {
+            array.insert(distribution(generator));
+            if (i % 10 == 0) array.view();
+        }
+        array.compact();
+
+        CHECK(before.toVector() == std::vector<int>({ 1, 3, 5, 9 }));
+        CHECK(array.size() == 204);
+        CHECK(array.runCount() == 1);
+        CHECK(array.view().size() == 204);
+    }
+
+    SUBCASE("Custom comparator") {
+        LeveledSortedArray<int, std::greater<int>> array("quicksort");
+        std::vector<int> all;
+        for (int batch = 0; batch < 20; batch++) {
+            for (int i = 0; i < 50 + batch * 10; i++) {
+                int value = distribution(generator);
+                array.insert(value);
+                all.push_back(value);
+            }
+            array.flush();
+        }
+        std::sort(all.begin(), all.end(), std::greater<int>());
+
+        LeveledSortedArray<int, std::greater<int>>::View view = array.view();
+        CHECK(view.toVector(1) == all);
+        CHECK(view.at(0) == all.front());
+        CHECK(view.rank(2500) == static_cast<std::size_t>(
+            std::lower_bound(all.begin(), all.end(), 2500, std::greater<int>()) - all.begin()));
+        CHECK(view.contains(all.back()));
+
+        array.compact();
+        CHECK(array.view().toVector() == all);
+    }
+
+    SUBCASE("Unknown strategies are reported") {
+        CHECK_THROWS_AS(LeveledSortedArray<int>("burstsort"), std::invalid_argument);
+        CHECK_THROWS_AS((LeveledSortedArray<int, std::greater<int>>("countingsort")), std::invalid_argument);
+    }
+}
+
+static std::FILE* writeTemporaryInput(const std::vector<std::uint32_t>& values) {
+    std::FILE* file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    if (!values.empty()) {
+        REQUIRE(std::fwrite(values.data(), sizeof(std::uint32_t), values.size(), file) == values.size());
+    }
+    std::rewind(file);
+    return file;
+}
+
+static std::vector<std::vector<std::uint32_t>> readAndRemoveRuns(const std::vector<std::string>& paths) {
+    std::vector<std::vector<std::uint32_t>> runs;
+    for (const auto& path : paths) {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        REQUIRE(file != nullptr);
+        std::vector<std::uint32_t> run;
+        std::uint32_t value;
+        while (std::fread(&value, sizeof(value), 1, file) == 1) run.push_back(value);
+        std::fclose(file);
+        std::remove(path.c_str());
+        runs.push_back(run);
+    }
+    return runs;
+}
+
+TEST_CASE("ExternalRunGenerator") {
+    std::mt19937 generator(31);
+    const std::size_t memory = 1000;
+    std::vector<std::uint32_t> random(20000);
+    for (auto& value : random) value = generator() % 50000;
+
+    auto generateRuns = [memory](const std::vector<std::uint32_t>& input, RunGeneration method, ExternalRunStats& stats) {
+        std::FILE* file = writeTemporaryInput(input);
+        ExternalRunGenerator<std::uint32_t> runs(memory, "sorts_tests_run_", method);
+        std::vector<std::string> paths = runs.generate(file);
+        std::fclose(file);
+        stats = runs.stats();
+        CHECK(stats.runCount == paths.size());
+        CHECK(stats.elementsRead == input.size());
+        CHECK(stats.bytesWritten == input.size() * sizeof(std::uint32_t));
+
+        std::vector<std::vector<std::uint32_t>> result = readAndRemoveRuns(paths);
+        std::vector<std::uint32_t> all;
+        for (const auto& run : result) {
+            CHECK(std::is_sorted(run.begin(), run.end()));
+            all.insert(all.end(), run.begin(), run.end());
+        }
+        std::vector<std::uint32_t> expected = input;
+        std::sort(all.begin(), all.end());
+        std::sort(expected.begin(), expected.end());
+        CHECK(all == expected);
+        return result;
+    };
+
+    SUBCASE("Replacement selection doubles the run length on random input") {
+        ExternalRunStats stats;
+        std::vector<std::vector<std::uint32_t>> runs = generateRuns(random, RunGeneration::ReplacementSelection, stats);
+        CHECK(stats.method == RunGeneration::ReplacementSelection);
+        CHECK(runs.size() >= 9);
+        CHECK(runs.size() <= 12);
+        for (std::size_t i = 0; i + 1 < runs.size(); i++) {
+            CHECK(runs[i].size() >= memory);
+        }
+
+        generateRuns(random, RunGeneration::LoadSortStore, stats);
+        CHECK(stats.runCount == 20);
+        CHECK(stats.mergePasses(4) == 3);
+        CHECK(stats.mergePasses(20) == 1);
+    }
+
+    SUBCASE("Nearly sorted input becomes a single run") {
+        std::vector<std::uint32_t> nearly(20000);
+        for (std::uint32_t i = 0; i < nearly.size(); i++) nearly[i] = i;
+        for (std::size_t i = 0; i < 200; i++) std::swap(nearly[generator() % nearly.size()], nearly[generator() % nearly.size()]);
+
+        ExternalRunStats stats;
+        generateRuns(nearly, RunGeneration::Auto, stats);
+        CHECK(stats.method == RunGeneration::ReplacementSelection);
+        CHECK(stats.sortedness >= 0.9);
+        CHECK(stats.runCount <= 3);
+    }
+
+    SUBCASE("The automatic choice follows the input") {
+        std::vector<std::uint32_t> descending(random);
+        std::sort(descending.begin(), descending.end(), std::greater<std::uint32_t>());
+
+        ExternalRunStats stats;
+        generateRuns(descending, RunGeneration::Auto, stats);
+        CHECK(stats.method == RunGeneration::LoadSortStore);
+        CHECK(stats.runCount == 20);
+
+        // Twenty load-sort-store runs already merge in one pass with the default fan-in.
+        generateRuns(random, RunGeneration::Auto, stats);
+        CHECK(stats.method == RunGeneration::LoadSortStore);
+
+        std::vector<std::uint32_t> large(100000);
+        for (auto& value : large) value = generator();
+        generateRuns(large, RunGeneration::Auto, stats);
+        CHECK(stats.method == RunGeneration::ReplacementSelection);
+        CHECK(stats.runCount < 60);
+
+        ExternalRunGenerator<std::uint32_t> narrow(memory, "sorts_tests_run_", RunGeneration::Auto, 8);
+        std::FILE* file = writeTemporaryInput(random);
+        readAndRemoveRuns(narrow.generate(file));
+        std::fclose(file);
+        CHECK(narrow.stats().method == RunGeneration::ReplacementSelection);
+    }
+
+    SUBCASE("Empty input writes no runs") {
+        ExternalRunStats stats;
+        generateRuns(std::vector<std::uint32_t>(), RunGeneration::Auto, stats);
+        CHECK(stats.runCount == 0);
+    }
+}
+
+// Prints the runs and bytes written for an input ten times the workspace; with -ts or --no-skip.
+// The total counts every merge pass at fan-in 8 as rewriting the runs once.
+TEST_CASE("ExternalRunGenerator benchmark at 10x the workspace" * doctest::skip()) {
+    const std::size_t memory = 2000000;
+    const std::size_t size = 10 * memory;
+    const std::size_t fanIn = 8;
+    std::mt19937 generator(49);
+
+    std::vector<std::uint32_t> random(size);
+    for (auto& value : random) value = generator();
+    std::vector<std::uint32_t> nearlySorted = random;
+    std::sort(nearlySorted.begin(), nearlySorted.end());
+    for (std::size_t i = 0; i < size / 100; i++) {
+        std::swap(nearlySorted[generator() % size], nearlySorted[generator() % size]);
+    }
+    std::vector<std::uint32_t> descending(nearlySorted.rbegin(), nearlySorted.rend());
+
+    struct Input { const char* name; const std::vector<std::uint32_t>* values; };
+    const Input inputs[] = { { "random", &random }, { "nearly sorted", &nearlySorted }, { "descending", &descending } };
+    MESSAGE("input          method  runs  passes  total MB   seconds");
+    for (const Input& input : inputs) {
+        for (RunGeneration method : { RunGeneration::LoadSortStore, RunGeneration::ReplacementSelection, RunGeneration::Auto }) {
+            std::FILE* file = writeTemporaryInput(*input.values);
+            ExternalRunGenerator<std::uint32_t> runs(memory, "sorts_tests_bench_", method, fanIn);
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::string> paths = runs.generate(file);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::fclose(file);
+            for (const auto& path : paths) std::remove(path.c_str());
+
+            const ExternalRunStats& stats = runs.stats();
+            CHECK(stats.elementsRead == size);
+            std::size_t passes = stats.mergePasses(fanIn);
+            std::ostringstream row;
+            row << std::left << std::setw(15) << input.name
+                << std::setw(8) << (method == RunGeneration::Auto ? "auto"
+                    : stats.method == RunGeneration::ReplacementSelection ? "rs" : "lss")
+                << std::right << std::setw(4) << stats.runCount << std::setw(8) << passes
+                << std::fixed << std::setprecision(0) << std::setw(10) << stats.bytesWritten * (1.0 + passes) / 1e6
+                << std::setprecision(2) << std::setw(10) << seconds;
+            if (method == RunGeneration::Auto)
+                row << "  (" << (stats.method == RunGeneration::ReplacementSelection ? "rs" : "lss") << ")";
+            MESSAGE(row.str());
+        }
+    }
+}
+
+TEST_CASE("ExternalRunGenerator I/O paths") {
+    std::mt19937 generator(37);
+    std::vector<std::uint32_t> input(30000);
+    for (auto& value : input) value = generator();
+
+    std::FILE* file = writeTemporaryInput(input);
+    ExternalRunGenerator<std::uint32_t> blocking(1000, "sorts_tests_run_", RunGeneration::ReplacementSelection);
+    AsyncIoOptions stdio;
+    stdio.enabled = false;
+    blocking.setIoOptions(stdio);
+    std::vector<std::vector<std::uint32_t>> expected = readAndRemoveRuns(blocking.generate(file));
+    std::fclose(file);
+    CHECK(std::string(blocking.stats().io.backend) == "stdio");
+    CHECK(blocking.stats().io.bytesWritten == input.size() * sizeof(std::uint32_t));
+    CHECK(blocking.stats().io.overlap() == doctest::Approx(0.0));
+
+#if defined(SORTS_HAS_POSIX_IO)
+    SUBCASE("Asynchronous streams write the same runs") {
+        for (unsigned depth : { 2u, 5u }) {
+            CAPTURE(depth);
+            AsyncIoOptions options;
+            options.blockBytes = 4096 * depth;
+            options.depth = depth;
+
+            file = writeTemporaryInput(input);
+            ExternalRunGenerator<std::uint32_t> runs(1000, "sorts_tests_run_", RunGeneration::ReplacementSelection);
+            runs.setIoOptions(options);
+            CHECK(readAndRemoveRuns(runs.generate(file)) == expected);
+            CHECK(std::feof(file) == 0);
+            CHECK(std::ftell(file) == static_cast<long>(input.size() * sizeof(std::uint32_t)));
+            std::fclose(file);
+
+            const AsyncIoStats& io = runs.stats().io;
+            CHECK(std::string(io.backend) != "stdio");
+            CHECK(io.bytesRead >= input.size() * sizeof(std::uint32_t));
+            CHECK(io.bytesWritten >= input.size() * sizeof(std::uint32_t));
+            CHECK(io.overlap() >= 0.0);
+            CHECK(io.overlap() <= 1.0);
+        }
+    }
+
+    SUBCASE("I/O time counts parallel requests once") {
+        std::FILE* scratch = std::tmpfile();
+        REQUIRE(scratch != nullptr);
+        std::vector<char> bytes(1 << 20, 'x');
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        AsyncIoStats io;
+        {
+            AsyncIoService service(8, 8);
+            std::vector<std::size_t> tickets;
+            for (std::size_t i = 0; i < 8; i++) {
+                tickets.push_back(service.submitWrite(fileno(scratch), bytes.data(), bytes.size(), i * bytes.size()));
+            }
+            for (std::size_t ticket : tickets) {
+                service.wait(ticket);
+            }
+            io = service.stats();
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::fclose(scratch);
+
+        CHECK(io.bytesWritten == 8 * bytes.size());
+        CHECK(io.ioSeconds > 0.0);
+        CHECK(io.ioSeconds <= wall);
+        CHECK(io.stallSeconds <= wall);
+    }
+
+    SUBCASE("Input paths with O_DIRECT, where the file system allows it") {
+        const char* path = "sorts_tests_input.bin";
+        std::FILE* out = std::fopen(path, "wb");
+        REQUIRE(out != nullptr);
+        std::fwrite(input.data(), sizeof(std::uint32_t), input.size(), out);
+        std::fclose(out);
+
+        AsyncIoOptions options;
+        options.directIo = true;
+        options.blockBytes = 64 * 1024;
+        ExternalRunGenerator<std::uint32_t> runs(1000, "sorts_tests_run_", RunGeneration::ReplacementSelection);
+        runs.setIoOptions(options);
+        std::vector<std::string> paths = runs.generate(std::string(path));
+        std::remove(path);
+        CHECK(readAndRemoveRuns(paths) == expected);
+        CHECK(runs.stats().elementsRead == input.size());
+    }
+
+    SUBCASE("Run files are removed when a run cannot be created") {
+        // A directory where the fourth run file would go makes creating it fail.
+        REQUIRE(::mkdir("sorts_tests_fail_3.run", 0755) == 0);
+        for (bool asynchronous : { false, true }) {
+            CAPTURE(asynchronous);
+            AsyncIoOptions options;
+            options.enabled = asynchronous;
+
+            file = writeTemporaryInput(input);
+            ExternalRunGenerator<std::uint32_t> runs(1000, "sorts_tests_fail_", RunGeneration::LoadSortStore);
+            runs.setIoOptions(options);
+            CHECK_THROWS_AS(runs.generate(file), std::runtime_error);
+            std::fclose(file);
+
+            for (int run = 0; run < 3; run++) {
+                std::string path = "sorts_tests_fail_" + std::to_string(run) + ".run";
+                CAPTURE(path);
+                CHECK(::access(path.c_str(), F_OK) != 0);
+            }
+        }
+        CHECK(::rmdir("sorts_tests_fail_3.run") == 0);
+    }
+
+    SUBCASE("Failed reads are reported") {
+        AsyncIoService io(1);
+        std::vector<char> buffer(4096);
+        std::size_t ticket = io.submitRead(-1, buffer.data(), buffer.size(), 0);
+        CHECK_THROWS_AS(io.wait(ticket), std::runtime_error);
+    }
+#endif
+}